@@ -6,3 +6,10 @@ void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+
+/* Commit and decommit hooks of the reserved-range backend
+ * (memlib_reserve.c, make MEMLIB=reserve); not in memlib.o */
+typedef int (*mem_commit_fn)(void *addr, size_t len);
+typedef void (*mem_decommit_fn)(void *addr, size_t len);
+void mem_set_hooks(mem_commit_fn commit, mem_decommit_fn decommit);
+void mem_decommit(void *addr, size_t len);
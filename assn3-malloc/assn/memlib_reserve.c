@@ -0,0 +1,170 @@
+/*
+ * memlib_reserve.c - memlib backend on a reserved range of real memory.
+ *
+ * A drop-in replacement for memlib.o (make MEMLIB=reserve).  Instead of a
+ * fixed malloc'd buffer, mem_init reserves MEM_RESERVE_SIZE bytes of
+ * address space with PROT_NONE, aligned to a huge page, and mem_sbrk
+ * commits it a huge page at a time as the break moves up.  The range is
+ * advised MADV_HUGEPAGE, so with transparent huge pages a big heap is
+ * backed by 2 MiB pages rather than thousands of 4 KiB TLB entries.
+ *
+ * Committing and decommitting go through hooks that mem_set_hooks can
+ * replace, e.g. to account for or pre-fault memory.  The default commit
+ * makes the range readable and writable; the default decommit drops its
+ * pages with MADV_DONTNEED, leaving it usable (it faults back zeroed).
+ * mm.c releases the pages inside large free blocks through mem_decommit
+ * when this backend is linked in.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "memlib.h"
+
+/* Address space reserved by mem_init; only what the break covers is
+ * committed. MAP_NORESERVE keeps the reservation out of the overcommit
+ * accounting */
+#ifndef MEM_RESERVE_SIZE
+#define MEM_RESERVE_SIZE    ((size_t)64 << 30)
+#endif
+
+/* Commit granularity and alignment of the range: one huge page */
+#define MEM_COMMIT_SIZE     ((size_t)2 << 20)
+
+static char *mem_start_brk;     /* first byte of the heap, huge page aligned */
+static char *mem_brk;           /* last byte of the heap plus one */
+static char *mem_commit_end;    /* end of the committed range */
+static char *mem_max_addr;      /* end of the reserved range */
+
+static int default_commit(void *addr, size_t len)
+{
+    return mprotect(addr, len, PROT_READ | PROT_WRITE);
+}
+
+static void default_decommit(void *addr, size_t len)
+{
+    madvise(addr, len, MADV_DONTNEED);
+}
+
+static mem_commit_fn commit_hook = default_commit;
+static mem_decommit_fn decommit_hook = default_decommit;
+
+/**********************************************************
+ * mem_init
+ * Reserve the range and align it to a huge page by trimming
+ * the over-reserved ends
+ **********************************************************/
+void mem_init(void)
+{
+    size_t len = MEM_RESERVE_SIZE + MEM_COMMIT_SIZE;
+    char *raw, *start;
+
+    raw = mmap(NULL, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        fprintf(stderr, "mem_init_vm: mmap error\n");
+        exit(1);
+    }
+    start = (char *)(((uintptr_t)raw + MEM_COMMIT_SIZE - 1) & ~(uintptr_t)(MEM_COMMIT_SIZE - 1));
+    if (start > raw)
+        munmap(raw, start - raw);
+    munmap(start + MEM_RESERVE_SIZE, raw + len - (start + MEM_RESERVE_SIZE));
+#ifdef MADV_HUGEPAGE
+    madvise(start, MEM_RESERVE_SIZE, MADV_HUGEPAGE);
+#endif
+
+    mem_start_brk = start;
+    mem_brk = start;
+    mem_commit_end = start;
+    mem_max_addr = start + MEM_RESERVE_SIZE;
+}
+
+/**********************************************************
+ * mem_deinit
+ * Release the whole range
+ **********************************************************/
+void mem_deinit(void)
+{
+    munmap(mem_start_brk, mem_max_addr - mem_start_brk);
+    mem_start_brk = mem_brk = mem_commit_end = mem_max_addr = NULL;
+}
+
+/**********************************************************
+ * mem_reset_brk
+ * Reset the break to an empty heap. The committed range is
+ * kept, as memlib keeps its buffer, so the next run does not
+ * pay for committing it again
+ **********************************************************/
+void mem_reset_brk(void)
+{
+    mem_brk = mem_start_brk;
+}
+
+/**********************************************************
+ * mem_sbrk
+ * Extend the heap by incr bytes, committing whole huge pages
+ * past the committed end. Return the old break, or (void *)-1
+ * with errno set to ENOMEM when the reservation or the commit
+ * cannot cover it. The heap cannot shrink
+ **********************************************************/
+void *mem_sbrk(intptr_t incr)
+{
+    char *old_brk = mem_brk;
+
+    if (incr < 0 || (size_t)incr > (size_t)(mem_max_addr - mem_brk)) {
+        errno = ENOMEM;
+        fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+        return (void *)-1;
+    }
+    if (mem_brk + incr > mem_commit_end) {
+        char *end = (char *)(((uintptr_t)mem_brk + incr + MEM_COMMIT_SIZE - 1) &
+                             ~(uintptr_t)(MEM_COMMIT_SIZE - 1));
+        if (end > mem_max_addr)
+            end = mem_max_addr;
+        if (commit_hook(mem_commit_end, end - mem_commit_end) != 0) {
+            errno = ENOMEM;
+            return (void *)-1;
+        }
+        mem_commit_end = end;
+    }
+    mem_brk += incr;
+    return old_brk;
+}
+
+void *mem_heap_lo(void)
+{
+    return mem_start_brk;
+}
+
+void *mem_heap_hi(void)
+{
+    return mem_brk - 1;
+}
+
+size_t mem_heapsize(void)
+{
+    return mem_brk - mem_start_brk;
+}
+
+size_t mem_pagesize(void)
+{
+    return getpagesize();
+}
+
+/**********************************************************
+ * mem_set_hooks
+ * Replace the commit and decommit hooks; NULL restores the
+ * default one. A commit hook returns 0 on success
+ **********************************************************/
+void mem_set_hooks(mem_commit_fn commit, mem_decommit_fn decommit)
+{
+    commit_hook = commit != NULL ? commit : default_commit;
+    decommit_hook = decommit != NULL ? decommit : default_decommit;
+}
+
+void mem_decommit(void *addr, size_t len)
+{
+    decommit_hook(addr, len);
+}
@@ -8,26 +8,64 @@
  * NOTE TO STUDENTS: Replace this header comment with your own header
  * comment that gives a high level description of your solution.
  */
+#define _GNU_SOURCE             /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/mman.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
 
+/* Only the reserved-range backend has mem_decommit, NULL with memlib.o */
+#pragma weak mem_decommit
+#include "mm_trace.h"
+
 /*********************************************************
  * Function Prototypes
  ********************************************************/
 void *find_block(size_t index, size_t asize);
 size_t get_flist_index(size_t asize);
+size_t find_nonempty_bin(size_t index);
 void insert_free_block(void *bp);
 void remove_free_block(void *bp);
+void tree_insert(void *bp);
+void tree_remove(void *bp);
+void *tree_best_fit(size_t asize);
 void *handle_split_block(void *bp, size_t asize);
 void print_flist(void);
+void print_ftree(void *bp);
 size_t get_extend_size(size_t asize);
+size_t grow_step(void);
+size_t get_adjusted_size(size_t size);
+void realloc_split_tail(void *bp, size_t asize);
+void *get_free_block(size_t asize);
+void *alloc_aligned_block(size_t align, size_t asize);
+void free_block(void *bp);
+void place(void *bp, size_t asize);
+void *heap_malloc(size_t size);
+size_t heap_malloc_batch(size_t size, size_t n, void **out);
+void *realloc_in_place(void *ptr, size_t size);
+void *slab_alloc(size_t size);
+void slab_free(void *ptr);
+void *mmap_alloc(size_t size);
+void mmap_free(void *bp);
+void *mmap_realloc(void *bp, size_t size);
+void *mmap_memalign(size_t align, size_t size);
+void *find_aligned_fit(size_t align, size_t asize);
+void trim_top(void *bp);
+size_t trim_tree(void *bp, void *top, size_t pad);
+int mm_check(void);
+void check_step(void *bp);
+void quick_consolidate(void);
+void heap_free(void *bp);
+void presplit(void *bp);
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -52,9 +90,27 @@ team_t team = {
 *************************************************************************/
 #define WSIZE       sizeof(void *)            /* word size (bytes) */
 #define DSIZE       (2 * WSIZE)            /* doubleword size (bytes) */
-#define CHUNKSIZE   (18 * WSIZE)      /* initial heap size (bytes) */
 
 #define MAX(x,y) ((x) > (y)?(x) :(y))
+#define MIN(x,y) ((x) < (y)?(x) :(y))
+
+/* Footer elision: with FOOTER_ELISION set (the default) only free blocks
+ * carry a footer. Whether the previous block is allocated is recorded in
+ * bit 1 of every header instead, so allocated blocks lose a word of
+ * overhead. Build with -DFOOTER_ELISION=0 to also write footers for
+ * allocated blocks; the prev-allocated bit is maintained in both modes */
+#ifndef FOOTER_ELISION
+#define FOOTER_ELISION 1
+#endif
+
+#if FOOTER_ELISION
+#define BLOCK_OVERHEAD  WSIZE          /* header only */
+#else
+#define BLOCK_OVERHEAD  DSIZE          /* header and footer */
+#endif
+
+#define ALLOC_BIT       0x1
+#define PREV_ALLOC_BIT  0x2
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc) ((size) | (alloc))
@@ -65,21 +121,54 @@ team_t team = {
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)     (GET(p) & ~(DSIZE - 1))
-#define GET_ALLOC(p)    (GET(p) & 0x1)
+#define GET_ALLOC(p)    (GET(p) & ALLOC_BIT)
+#define GET_PREV_ALLOC(p)   (GET(p) & PREV_ALLOC_BIT)
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)        ((char *)(bp) - WSIZE)
 #define FTRP(bp)        ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
-/* Given block ptr bp, compute address of next and previous blocks */
+/* Given block ptr bp, compute address of next and previous blocks.
+ * PREV_BLKP reads the previous block's footer, so it is only valid
+ * when the previous block is free (its PREV_ALLOC_BIT is clear in bp) */
 #define NEXT_BLKP(bp)   ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)   ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/* Write the header of bp keeping its prev-allocated bit, and the footer of a free bp */
+#define PUT_HDR(bp, size, alloc) \
+    (PUT(HDRP(bp), PACK(size, alloc) | GET_PREV_ALLOC(HDRP(bp))))
+#define PUT_FTR(bp, size)   (PUT(FTRP(bp), PACK(size, 0)))
+
+/* Write the header of an allocated bp, tagged with the id of the current heap */
+#define PUT_ALLOC_HDR(bp, size) \
+    (PUT(HDRP(bp), PACK(size, 1) | GET_PREV_ALLOC(HDRP(bp)) | \
+         ((uintptr_t)cur_heap->id << HEAP_TAG_SHIFT)))
+
+/* Set or clear the prev-allocated bit in the header of bp */
+#define SET_PREV_ALLOC(bp)  (PUT(HDRP(bp), GET(HDRP(bp)) | PREV_ALLOC_BIT))
+#define CLR_PREV_ALLOC(bp)  (PUT(HDRP(bp), GET(HDRP(bp)) & ~(uintptr_t)PREV_ALLOC_BIT))
+
 /* Given block ptr bp, compute the size of the block */
 #define GET_SIZE_FROM_BLK(bp)   (GET_SIZE(HDRP(bp)))
 
+/* Software prefetching of boundary tags and free list links on the free
+ * and fit paths, so that the misses on a large heap overlap instead of
+ * following one another. Build with -DMM_PREFETCH=0 to compare */
+#ifndef MM_PREFETCH
+#define MM_PREFETCH 1
+#endif
+
+#if MM_PREFETCH
+#define PREFETCH(p)     __builtin_prefetch((p), 0, 3)
+#define PREFETCH_W(p)   __builtin_prefetch((p), 1, 3)
+#else
+#define PREFETCH(p)     ((void)0)
+#define PREFETCH_W(p)   ((void)0)
+#endif
+
 /* The minimum number of words for a memory block is 4: 
- * header(1 word) + payload(2 words) + footer(1 word) = 4 words */
+ * header(1 word) + payload(2 words) + footer(1 word) = 4 words,
+ * since every block must be able to hold a free block's links and footer */
 #define MIN_BLOCK_SIZE (4 * WSIZE)
 
 /* Since the minimum payload of a free block is 2 words, use the first word
@@ -94,58 +183,776 @@ team_t team = {
 #define PUT_PREV_FBLOCK(bp, ptr) (PUT(bp, (uintptr_t) ptr))
 #define PUT_NEXT_FBLOCK(bp, ptr) (PUT((char *)(bp) + WSIZE, (uintptr_t) ptr))
 
-#define FREE_LIST_SIZE 20
+/* Free blocks of at least TREE_MIN_SIZE bytes are kept in a red-black tree
+ * ordered by (size, address) instead of the list bins. The tree node lives
+ * in the first 3 payload words: left child, right child and parent pointer,
+ * with the node colour in the low bit of the parent word (1 = red).
+ * TREE_MIN_SIZE must leave room for the node, i.e. be at least 5 words */
+#ifndef TREE_MIN_SIZE
+#define TREE_MIN_SIZE   1024
+#endif
+
+#define TREE_LEFT(bp)       ((void *) GET(bp))
+#define TREE_RIGHT(bp)      ((void *) GET((char *)(bp) + WSIZE))
+#define TREE_PARENT(bp)     ((void *) (GET((char *)(bp) + DSIZE) & ~(uintptr_t)1))
+#define TREE_IS_RED(bp)     ((bp) != NULL && (GET((char *)(bp) + DSIZE) & 1))
+
+#define PUT_TREE_LEFT(bp, ptr)  (PUT(bp, (uintptr_t) ptr))
+#define PUT_TREE_RIGHT(bp, ptr) (PUT((char *)(bp) + WSIZE, (uintptr_t) ptr))
+#define PUT_TREE_PARENT(bp, ptr) \
+    (PUT((char *)(bp) + DSIZE, (uintptr_t) (ptr) | (GET((char *)(bp) + DSIZE) & 1)))
+#define SET_TREE_RED(bp)    (PUT((char *)(bp) + DSIZE, GET((char *)(bp) + DSIZE) | 1))
+#define SET_TREE_BLACK(bp)  (PUT((char *)(bp) + DSIZE, GET((char *)(bp) + DSIZE) & ~(uintptr_t)1))
+
+/* Two-level segregated fit (TLSF style) size classes.
+ * The first level is the power of two of the block size (in DSIZE units),
+ * the second level splits each power of two into SL_INDEX_COUNT sub-bins */
+#define SL_INDEX_LOG2   2
+#define SL_INDEX_COUNT  (1 << SL_INDEX_LOG2)
+#define FL_INDEX_COUNT  32
+#define FREE_LIST_SIZE  (FL_INDEX_COUNT * SL_INDEX_COUNT)
+
+/* Blocks looked at per bin for one that fits an aligned request */
+#ifndef ALIGN_SCAN
+#define ALIGN_SCAN      16
+#endif
 
-void *flist[FREE_LIST_SIZE];
 int split_flag = 1;
 int coalesce_flag = 1;
 
+/* Splitting: a block is split only if the remainder is at least
+ * split_min_size bytes, otherwise the surplus stays with the allocation.
+ * A new extension keeps a surplus below fit_slack bytes unsplit as well.
+ * A realloc that moves its block asks for realloc_headroom percent more
+ * than requested, for the growth that usually follows. These and the heap
+ * growth parameters below can be changed with mm_set_params, and are
+ * searched on traces by mm_tune */
+#ifndef SPLIT_MIN_SIZE
+#define SPLIT_MIN_SIZE  MIN_BLOCK_SIZE
+#endif
+#ifndef FIT_SLACK
+#define FIT_SLACK       0
+#endif
+#ifndef REALLOC_HEADROOM
+#define REALLOC_HEADROOM    50
+#endif
+size_t split_min_size = SPLIT_MIN_SIZE;
+size_t fit_slack = FIT_SLACK;
+unsigned realloc_headroom = REALLOC_HEADROOM;
+
+/* Deferred coalescing: with QUICK_MAX_SIZE set, freed general blocks of at
+ * most QUICK_MAX_SIZE bytes are not coalesced but pushed, still marked
+ * allocated, on a quick-reuse list for their exact size, and a malloc of
+ * that size pops them without touching the bins. When find_fit misses,
+ * quick_consolidate sorts all deferred blocks by address and frees them in
+ * one sweep before the heap is extended. 0 (the default) coalesces every
+ * block as it is freed */
+#ifndef QUICK_MAX_SIZE
+#define QUICK_MAX_SIZE  0
+#endif
+
+/* Heap growth: extensions that follow each other within GROW_WINDOW
+ * mallocs double the heap's growth step, from GROW_MIN_SIZE up to
+ * GROW_MAX_SIZE, and a quiet spell starts over from GROW_MIN_SIZE. What is
+ * obtained beyond the request never exceeds 1 / 2**GROW_HEAP_SHIFT of the
+ * heap, which bounds the cost in peak utilization. GROW_MAX_SIZE 0 extends
+ * by exactly the missing bytes.
+ * Mallocs of general blocks up to PRESPLIT_MAX_SIZE bytes are counted per
+ * exact size; up to half of the surplus of an extension is carved into
+ * blocks of the size most requested since the last extension and put on the
+ * quick lists, so the next mallocs of that size pop them without a search
+ * or a split. 0 disables the pre-splitting */
+#ifndef GROW_MIN_SIZE
+#define GROW_MIN_SIZE   (4 * 1024)
+#endif
+#ifndef GROW_MAX_SIZE
+#define GROW_MAX_SIZE   (256 * 1024)
+#endif
+#ifndef GROW_HEAP_SHIFT
+#define GROW_HEAP_SHIFT 7
+#endif
+#define GROW_WINDOW     1024
+size_t grow_min_size = GROW_MIN_SIZE;
+size_t grow_max_size = GROW_MAX_SIZE;
+unsigned grow_heap_shift = GROW_HEAP_SHIFT;
+#ifndef PRESPLIT_MAX_SIZE
+#define PRESPLIT_MAX_SIZE   1024
+#endif
+#if PRESPLIT_MAX_SIZE
+#define DEMAND_COUNT    ((PRESPLIT_MAX_SIZE - MIN_BLOCK_SIZE) / DSIZE + 1)
+#else
+#define DEMAND_COUNT    1
+#endif
+
+/* Quick lists hold both deferred and pre-split blocks */
+#define QUICK_LIMIT     MAX(QUICK_MAX_SIZE, PRESPLIT_MAX_SIZE)
+#if QUICK_LIMIT
+#define QUICK_COUNT     ((int)((QUICK_LIMIT - MIN_BLOCK_SIZE) / DSIZE) + 1)
+#else
+#define QUICK_COUNT     1
+#endif
+#define QUICK_INDEX(asize)  (((asize) - MIN_BLOCK_SIZE) / DSIZE)
+#define QUICK_NEXT(bp)      ((void *) GET(bp))
+#define PUT_QUICK_NEXT(bp, ptr) (PUT(bp, (uintptr_t) ptr))
+
+/* mm_malloc_batch carves general blocks out of one free block, or one
+ * extension, of up to BATCH_MAX_SIZE bytes at a time */
+#ifndef BATCH_MAX_SIZE
+#define BATCH_MAX_SIZE  (256 * 1024)
+#endif
+
+/* Requests of at least mmap_threshold bytes bypass the heap and get an
+ * anonymous mapping of their own, which mm_free unmaps right away and
+ * mm_realloc resizes with mremap. 0 disables the mmap path.
+ * mdriver only accepts blocks inside the memlib heap, so the default is
+ * kept above the largest request of the traces */
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD  (1 << 20)
+#endif
+size_t mmap_threshold = MMAP_THRESHOLD;
+
+/* A mapped block starts with a two word header: the length of the mapping,
+ * then a block header of size 0 with the allocated bit set. No heap block
+ * has size 0 (only the epilogue does), which tags the block as mapped */
+#define MMAP_HDR_SIZE       DSIZE
+#define MMAP_LEN(bp)        (GET((char *)(bp) - DSIZE))
+/* Start of the mapping: the header sits at its start, or for a block from
+ * mmap_memalign later in its first page */
+#define MMAP_BASE(bp) \
+    ((char *)(((uintptr_t)(bp) - MMAP_HDR_SIZE) & ~(uintptr_t)(mem_pagesize() - 1)))
+#define IS_MMAPPED(bp)      (GET(HDRP(bp)) == PACK(0, ALLOC_BIT))
+
+/* memlib cannot lower the break, so memory is given back by releasing the
+ * whole pages inside free blocks with madvise(MADV_DONTNEED), or the
+ * decommit hook of memlib_reserve.c. Only the
+ * block header, tree node and footer stay resident.
+ * When a free makes the last block of a heap free and at least
+ * trim_threshold bytes of it are not released yet, they are released.
+ * mm_trim does the same for every large free block on request.
+ * Released pages fault back in (zeroed) when they are reused, so a low
+ * threshold trades throughput for resident memory. 0 disables automatic
+ * trimming */
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD  (2 << 20)
+#endif
+size_t trim_threshold = TRIM_THRESHOLD;
+
+/* Incremental heap checking: with MM_CHECK_SLICE > 0 every malloc, free
+ * and in-place realloc verifies the block it touched and its neighbours,
+ * then the next MM_CHECK_SLICE blocks of a walk that cycles through the
+ * heap, and aborts on the first inconsistency. The full walk is done by
+ * mm_check. In concurrent mode, and in heaps made by mm_heap_create, only
+ * the touched neighbours are checked.
+ * check_cursor is where the walk resumes; blocks that disappear in a
+ * merge are forgotten so it never points into the middle of a block */
+#ifndef MM_CHECK_SLICE
+#define MM_CHECK_SLICE  0
+#endif
+#if MM_CHECK_SLICE
+char *check_cursor;
+#define CHECK_STEP(bp)      check_step(bp)
+#define CHECK_FORGET(bp)    do { if (check_cursor == (char *)(bp)) check_cursor = NULL; } while (0)
+#else
+#define CHECK_STEP(bp)      ((void)0)
+#define CHECK_FORGET(bp)    ((void)0)
+#endif
+
+/* Slab front end: requests of at most SLAB_MAX_SIZE bytes are served from
+ * RUN_SIZE runs, each an aligned allocated block of the general heap that
+ * holds objects of one size class and a free bitmap but no per-object
+ * headers. Class sizes are multiples of 16 up to 128, then of 32 up to
+ * 256, so SLAB_MAX_SIZE can be at most 256; 0 disables the slabs */
+#ifndef SLAB_MAX_SIZE
+#define SLAB_MAX_SIZE   256
+#endif
+#define SLAB_CLASS_COUNT    12
+#define RUN_SHIFT       12
+#define RUN_SIZE        ((size_t)1 << RUN_SHIFT)
+#define RUN_OF(ptr)     ((slab_run_t *)((uintptr_t)(ptr) & ~(uintptr_t)(RUN_SIZE - 1)))
+#define RUN_MAP_WORDS   ((RUN_SIZE / 16 + 63) / 64)
+
+typedef struct slab_run {
+    struct slab_run *next;      /* links in the class's list of runs with free slots */
+    struct slab_run *prev;
+    struct mm_heap *heap;       /* owning heap */
+    char *objs;                 /* first object */
+    uint32_t obj_size;
+    uint16_t nobjs;
+    uint16_t nfree;
+    uint32_t sclass;
+    uint64_t free_map[RUN_MAP_WORDS];   /* bit set = slot free */
+} slab_run_t;
+
+/* Run map: bit i is set iff the RUN_SIZE region at slab_map_base + i * RUN_SIZE
+ * is a slab run. This is how mm_free tells header-less slab objects from
+ * general blocks. It covers SLAB_MAP_RUNS runs (4GB) of heap, runs are
+ * never carved beyond that. Shared by all arenas, so updated atomically */
+#define SLAB_MAP_RUNS   ((size_t)1 << 20)
+uint64_t slab_map[SLAB_MAP_RUNS / 64];
+uintptr_t slab_map_base;
+size_t slab_map_used;           /* words of slab_map ever touched */
+
+/* Concurrent mode (-DMM_THREADS, see mm_stress): ARENA_COUNT arenas, each
+ * with its own free lists and lock. Threads are assigned to arenas round
+ * robin, allocated general blocks record their arena in header bits 2-3,
+ * and slab runs in their run header. mem_sbrk is serialized by sbrk_lock.
+ * Each thread also caches up to TCACHE_COUNT freed slab objects per class,
+ * so a malloc/free pair of a small size takes no lock at all, and queues up
+ * to REMOTE_COUNT general blocks per other arena that it frees */
+#ifdef MM_THREADS
+#include <pthread.h>
+#define ARENA_COUNT     4
+#define TCACHE_COUNT    16
+#define REMOTE_COUNT    16
+#define MM_TLS          __thread
+#define MM_LOCK(m)      pthread_mutex_lock(m)
+#define MM_UNLOCK(m)    pthread_mutex_unlock(m)
+#else
+#define ARENA_COUNT     1
+#define MM_TLS
+#define MM_LOCK(m)      ((void)0)
+#define MM_UNLOCK(m)    ((void)0)
+#endif
+
+#define HEAP_TAG_SHIFT  2
+#define HEAP_TAG_MASK   (0x3 << HEAP_TAG_SHIFT)
+
+/* Counters of one heap, updated under its lock */
+typedef struct {
+    size_t live_bytes;
+    size_t bin_bytes[FREE_LIST_SIZE];   /* free bytes per bin, tree blocks included */
+    unsigned long mallocs;
+    unsigned long frees;
+    unsigned long splits;
+    unsigned long coalesces[4];
+    unsigned long extends;
+    size_t extend_bytes;
+    size_t requested_bytes;
+    size_t allocated_bytes;
+} heap_stats_t;
+
+/* All free block state of one heap (arena) */
+typedef struct mm_heap {
+    void *flist[FREE_LIST_SIZE];
+
+    /* Occupancy bitmaps: bit fl of fl_bitmap is set iff sl_bitmap[fl] != 0,
+     * bit sl of sl_bitmap[fl] is set iff flist[fl * SL_INDEX_COUNT + sl] is non-empty */
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[FL_INDEX_COUNT];
+
+    /* Root of the large free block tree */
+    void *ftree;
+
+    /* Runs with at least one free slot, per size class */
+    slab_run_t *slab_partial[SLAB_CLASS_COUNT];
+
+    /* Freed blocks waiting to be coalesced and pre-split blocks, per exact size */
+    void *quick[QUICK_COUNT];
+    size_t quick_bytes;
+
+    /* Growth step of the next extension, the malloc count at the last one,
+     * and the general mallocs per exact size since then */
+    size_t grow_size;
+    unsigned long grow_mark;
+    uint32_t demand[DEMAND_COUNT];
+
+    /* Block pointer of the epilogue that ends this heap's latest segment,
+     * NULL before the heap got any memory */
+    char *heap_end;
+
+    /* Backing region of a heap made by mm_heap_create: the heap grows from
+     * region_brk up to region_end. NULL for the arenas, which use memlib */
+    char *region_brk;
+    char *region_end;
+
+    /* Bytes from fresh up to the break are still zero, except the footer
+     * of the last block and the epilogue header. Only known for a created
+     * heap, whose mapping starts zeroed; NULL for the arenas */
+    char *fresh;
+
+    /* Pages known to be released in the last free block, trim_lo up to
+     * trim_hi. Allocations that reach into the range move trim_lo up */
+    char *trim_lo;
+    char *trim_hi;
+
+    heap_stats_t stats;
+    unsigned id;
+#ifdef MM_THREADS
+    pthread_mutex_t lock;
+#endif
+} heap_t;
+
+heap_t arenas[ARENA_COUNT];
+
+/* Counters updated outside any heap lock */
+size_t mmap_bytes;
+unsigned long mmap_blocks;
+unsigned long realloc_in_place_count;
+unsigned long realloc_move_count;
+
+#define STAT_ADD(field, n)      (cur_heap->stats.field += (n))
+#define STAT_ATOMIC_ADD(var, n) __atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED)
+
+typedef char stats_bins_check[FREE_LIST_SIZE == MM_STATS_BINS ? 1 : -1];
+
+/* The heap the current operation works on. Set on entry to the public
+ * functions, after taking that heap's lock */
+MM_TLS heap_t *cur_heap = &arenas[0];
+
+#ifdef MM_THREADS
+pthread_mutex_t sbrk_lock = PTHREAD_MUTEX_INITIALIZER;
+unsigned next_arena;
+MM_TLS heap_t *thread_heap;
+
+typedef struct {
+    unsigned count;
+    void *slots[TCACHE_COUNT];
+} tcache_bin_t;
+
+MM_TLS tcache_bin_t tcache[SLAB_CLASS_COUNT];
+MM_TLS int tcache_registered;
+
+/* General blocks of another arena freed by this thread */
+typedef struct {
+    unsigned count;
+    void *slots[REMOTE_COUNT];
+} remote_bin_t;
+
+MM_TLS remote_bin_t remote_free[ARENA_COUNT];
+pthread_key_t tcache_key;
+pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+static void fork_register(void);
+#endif
+
+#define HEAP_ENTER(h)   do { MM_LOCK(&(h)->lock); cur_heap = (h); } while (0)
+#define HEAP_LEAVE(h)   MM_UNLOCK(&(h)->lock)
+#define SBRK_LOCK()     MM_LOCK(&sbrk_lock)
+#define SBRK_UNLOCK()   MM_UNLOCK(&sbrk_lock)
+
+/* Arena that owns the allocated general block bp */
+#define HEAP_OF(bp)     (&arenas[(GET(HDRP(bp)) & HEAP_TAG_MASK) >> HEAP_TAG_SHIFT])
+
+/* Bump allocation arenas (mm_arena_begin): objects are carved without
+ * headers from chunks of the general heap, the first word of each chunk
+ * links it to the previous one. Objects larger than a quarter of a chunk
+ * are general blocks of their own, linked through a word in front of them.
+ * mm_arena_reset frees all but the current chunk */
+struct mm_arena {
+    char *cur;                  /* next free byte of the current chunk */
+    char *end;                  /* end of the current chunk */
+    void *chunks;               /* current chunk, linked to older ones */
+    void *large;                /* large objects, newest first */
+    size_t chunk_size;
+};
+
+#ifndef MM_ARENA_CHUNK
+#define MM_ARENA_CHUNK  (64 * 1024)
+#endif
+#define ARENA_LINK      DSIZE   /* link word, padded to keep alignment */
+
+/* Reserved size of a heap made by mm_heap_create(0) */
+#ifndef MM_HEAP_DEFAULT_SIZE
+#define MM_HEAP_DEFAULT_SIZE    (64 << 20)
+#endif
+
+/**********************************************************
+ * heap_top
+ * The break of the current heap's backing memory: the memlib
+ * break for the arenas, region_brk for a created heap
+ **********************************************************/
+static inline char *heap_top(void)
+{
+    if (cur_heap->region_end != NULL)
+        return cur_heap->region_brk;
+    return (char *)mem_heap_hi() + 1;
+}
+
+/**********************************************************
+ * heap_sbrk
+ * mem_sbrk for the current heap's backing memory. Returns
+ * (void *)-1 when it is exhausted
+ **********************************************************/
+static inline void *heap_sbrk(size_t size)
+{
+    heap_t *h = cur_heap;
+    char *old_brk = h->region_brk;
+
+    if (h->region_end == NULL)
+        return mem_sbrk(size);
+    if (size > (size_t)(h->region_end - old_brk))
+        return (void *)-1;
+    h->region_brk += size;
+    return old_brk;
+}
+
+/**********************************************************
+ * heap_size
+ * Bytes of backing memory the current heap has used
+ **********************************************************/
+static inline size_t heap_size(void)
+{
+    if (cur_heap->region_end != NULL)
+        return cur_heap->region_brk - (char *)cur_heap;
+    return mem_heapsize();
+}
+
+/**********************************************************
+ * trim_touch
+ * Note that the size bytes at bp (and the tree node of the
+ * block after them) are in use again, so they no longer count
+ * as released
+ **********************************************************/
+static inline void trim_touch(void *bp, size_t size)
+{
+    char *end = (char *)bp + size + 3 * WSIZE;
+    if (cur_heap->fresh != NULL && end > cur_heap->fresh)
+        cur_heap->fresh = end;
+    if (end > cur_heap->trim_lo && (char *)bp < cur_heap->trim_hi)
+        cur_heap->trim_lo = end < cur_heap->trim_hi ? end : cur_heap->trim_hi;
+}
+
 /**********************************************************
  * get_flist_index
- * Compute the index of the free list for a given size,
- * each element of the free block is a linked list of free blocks, 
- * with block sizes ranging from 2**(i+2) to 2**(i+3)-1 of words.
- * Assuming block sizes includes header and footer size and are aligned.
- * 
- * Eg. block of 4 ~ 7 words in the 1st linked list
-       block of 8 ~ 15 words in the 2nd linked list
-       block of 16 ~ 31 words in the 3rd linked list
- * 
- * For block sizes greater than 2**(FREE_LIST_SIZE+2), place them in the
- * last linked list.
+ * Compute the index of the free list for a given size.
+ * Sizes are counted in DSIZE units u (blocks are DSIZE aligned).
+ * Small blocks (u < SL_INDEX_COUNT) map one-to-one to the first bins,
+ * larger ones to first level fl = floor(log2(u)) - SL_INDEX_LOG2 + 1
+ * and second level sl = the SL_INDEX_LOG2 bits below the leading one.
+ *
+ * Eg. with 4 sub-bins, u = 4..7 map to bins 4..7,
+       u = 8,9 -> 8, u = 10,11 -> 9, ..., u = 16..19 -> 12
+ *
+ * The mapping is monotonic, so every block in a higher bin is larger
+ * than every block in a lower one. Sizes beyond the last first level
+ * are placed in the last bin.
  **********************************************************/
 size_t get_flist_index(size_t asize)
 {
-    size_t index;
-    /* max_size is the max block size for each segregated linked list */
-    size_t max_size = 8;
-    for (index = 0; index < FREE_LIST_SIZE; index++) {
-        if (asize < max_size) {
-            break;
+    size_t u = asize / DSIZE;
+    size_t fl, sl, msb;
+
+    if (u < SL_INDEX_COUNT)
+        return u;
+
+    /* Index of the leading one bit, computed with count-leading-zeros */
+    msb = sizeof(unsigned long) * 8 - 1 - __builtin_clzl(u);
+    fl = msb - SL_INDEX_LOG2 + 1;
+    sl = (u >> (msb - SL_INDEX_LOG2)) ^ SL_INDEX_COUNT;
+
+    /* Cap the index by size of free list */
+    if (fl >= FL_INDEX_COUNT)
+        return FREE_LIST_SIZE - 1;
+    return fl * SL_INDEX_COUNT + sl;
+}
+
+/**********************************************************
+ * find_nonempty_bin
+ * Return the index of the first non-empty bin at or above index,
+ * or FREE_LIST_SIZE if there is none. Two count-trailing-zeros
+ * lookups in the occupancy bitmaps, no scanning of empty bins.
+ **********************************************************/
+size_t find_nonempty_bin(size_t index)
+{
+    size_t fl = index / SL_INDEX_COUNT;
+    size_t sl = index % SL_INDEX_COUNT;
+    uint32_t sl_map, fl_map;
+
+    if (index >= FREE_LIST_SIZE)
+        return FREE_LIST_SIZE;
+
+    sl_map = cur_heap->sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        /* Nothing left in this first level, move to the next non-empty one */
+        fl_map = (fl + 1 < FL_INDEX_COUNT) ? cur_heap->fl_bitmap & (~0u << (fl + 1)) : 0;
+        if (!fl_map)
+            return FREE_LIST_SIZE;
+        fl = __builtin_ctz(fl_map);
+        sl_map = cur_heap->sl_bitmap[fl];
+    }
+    return fl * SL_INDEX_COUNT + __builtin_ctz(sl_map);
+}
+
+/**********************************************************
+ * tree_less
+ * Order of the free block tree: by size, then by address so
+ * that keys are unique and ties resolve to the lowest block
+ **********************************************************/
+static inline int tree_less(void *a, void *b)
+{
+    size_t sa = GET_SIZE_FROM_BLK(a);
+    size_t sb = GET_SIZE_FROM_BLK(b);
+    return sa < sb || (sa == sb && a < b);
+}
+
+/**********************************************************
+ * tree_replace_child
+ * Make new_child take the place of old_child under parent
+ **********************************************************/
+static inline void tree_replace_child(void *parent, void *old_child, void *new_child)
+{
+    if (parent == NULL) {
+        cur_heap->ftree = new_child;
+    } else if (TREE_LEFT(parent) == old_child) {
+        PUT_TREE_LEFT(parent, new_child);
+    } else {
+        PUT_TREE_RIGHT(parent, new_child);
+    }
+    if (new_child != NULL) {
+        PUT_TREE_PARENT(new_child, parent);
+    }
+}
+
+static void tree_rotate_left(void *x)
+{
+    void *y = TREE_RIGHT(x);
+    void *y_left = TREE_LEFT(y);
+
+    PUT_TREE_RIGHT(x, y_left);
+    if (y_left != NULL) {
+        PUT_TREE_PARENT(y_left, x);
+    }
+    tree_replace_child(TREE_PARENT(x), x, y);
+    PUT_TREE_LEFT(y, x);
+    PUT_TREE_PARENT(x, y);
+}
+
+static void tree_rotate_right(void *x)
+{
+    void *y = TREE_LEFT(x);
+    void *y_right = TREE_RIGHT(y);
+
+    PUT_TREE_LEFT(x, y_right);
+    if (y_right != NULL) {
+        PUT_TREE_PARENT(y_right, x);
+    }
+    tree_replace_child(TREE_PARENT(x), x, y);
+    PUT_TREE_RIGHT(y, x);
+    PUT_TREE_PARENT(x, y);
+}
+
+/**********************************************************
+ * tree_insert
+ * Insert a large free block into the red-black tree and
+ * restore the red-black properties
+ **********************************************************/
+void tree_insert(void *bp)
+{
+    void *parent = NULL;
+    void *cur = cur_heap->ftree;
+
+    while (cur != NULL) {
+        parent = cur;
+        cur = tree_less(bp, cur) ? TREE_LEFT(cur) : TREE_RIGHT(cur);
+    }
+
+    PUT_TREE_LEFT(bp, NULL);
+    PUT_TREE_RIGHT(bp, NULL);
+    PUT((char *)(bp) + DSIZE, (uintptr_t) parent | 1);
+    if (parent == NULL) {
+        cur_heap->ftree = bp;
+    } else if (tree_less(bp, parent)) {
+        PUT_TREE_LEFT(parent, bp);
+    } else {
+        PUT_TREE_RIGHT(parent, bp);
+    }
+
+    /* Fix up red parent / red child violations going up */
+    while (TREE_IS_RED(parent = TREE_PARENT(bp))) {
+        void *grand = TREE_PARENT(parent);
+        void *uncle;
+        if (parent == TREE_LEFT(grand)) {
+            uncle = TREE_RIGHT(grand);
+            if (TREE_IS_RED(uncle)) {
+                SET_TREE_BLACK(parent);
+                SET_TREE_BLACK(uncle);
+                SET_TREE_RED(grand);
+                bp = grand;
+                continue;
+            }
+            if (bp == TREE_RIGHT(parent)) {
+                tree_rotate_left(parent);
+                bp = parent;
+                parent = TREE_PARENT(bp);
+            }
+            SET_TREE_BLACK(parent);
+            SET_TREE_RED(grand);
+            tree_rotate_right(grand);
+        } else {
+            uncle = TREE_LEFT(grand);
+            if (TREE_IS_RED(uncle)) {
+                SET_TREE_BLACK(parent);
+                SET_TREE_BLACK(uncle);
+                SET_TREE_RED(grand);
+                bp = grand;
+                continue;
+            }
+            if (bp == TREE_LEFT(parent)) {
+                tree_rotate_right(parent);
+                bp = parent;
+                parent = TREE_PARENT(bp);
+            }
+            SET_TREE_BLACK(parent);
+            SET_TREE_RED(grand);
+            tree_rotate_left(grand);
         }
-        /* Multiply the max_size by 2 */
-        max_size <<= 1;
     }
-    /* Cap the index by size of free list */
-    index = (index < FREE_LIST_SIZE) ? index : FREE_LIST_SIZE - 1;
-    return index;
+    SET_TREE_BLACK(cur_heap->ftree);
+}
+
+/**********************************************************
+ * tree_remove
+ * Unlink a large free block from the red-black tree and
+ * restore the red-black properties
+ **********************************************************/
+void tree_remove(void *bp)
+{
+    void *child, *parent, *sibling;
+    int removed_red;
+
+    if (TREE_LEFT(bp) == NULL || TREE_RIGHT(bp) == NULL) {
+        /* At most one child, splice bp out directly */
+        child = TREE_LEFT(bp) ? TREE_LEFT(bp) : TREE_RIGHT(bp);
+        parent = TREE_PARENT(bp);
+        removed_red = TREE_IS_RED(bp);
+        tree_replace_child(parent, bp, child);
+    } else {
+        /* Two children, move the in-order successor into bp's place */
+        void *succ = TREE_RIGHT(bp);
+        while (TREE_LEFT(succ) != NULL) {
+            succ = TREE_LEFT(succ);
+        }
+        removed_red = TREE_IS_RED(succ);
+        child = TREE_RIGHT(succ);
+        if (TREE_PARENT(succ) == bp) {
+            parent = succ;
+        } else {
+            parent = TREE_PARENT(succ);
+            tree_replace_child(parent, succ, child);
+            PUT_TREE_RIGHT(succ, TREE_RIGHT(bp));
+            PUT_TREE_PARENT(TREE_RIGHT(succ), succ);
+        }
+        tree_replace_child(TREE_PARENT(bp), bp, succ);
+        PUT_TREE_LEFT(succ, TREE_LEFT(bp));
+        PUT_TREE_PARENT(TREE_LEFT(succ), succ);
+        if (TREE_IS_RED(bp)) {
+            SET_TREE_RED(succ);
+        } else {
+            SET_TREE_BLACK(succ);
+        }
+    }
+
+    if (removed_red) {
+        return;
+    }
+
+    /* A black node was removed, push the missing black up the tree */
+    while (child != cur_heap->ftree && !TREE_IS_RED(child)) {
+        if (child == TREE_LEFT(parent)) {
+            sibling = TREE_RIGHT(parent);
+            if (TREE_IS_RED(sibling)) {
+                SET_TREE_BLACK(sibling);
+                SET_TREE_RED(parent);
+                tree_rotate_left(parent);
+                sibling = TREE_RIGHT(parent);
+            }
+            if (!TREE_IS_RED(TREE_LEFT(sibling)) && !TREE_IS_RED(TREE_RIGHT(sibling))) {
+                SET_TREE_RED(sibling);
+                child = parent;
+                parent = TREE_PARENT(child);
+            } else {
+                if (!TREE_IS_RED(TREE_RIGHT(sibling))) {
+                    SET_TREE_BLACK(TREE_LEFT(sibling));
+                    SET_TREE_RED(sibling);
+                    tree_rotate_right(sibling);
+                    sibling = TREE_RIGHT(parent);
+                }
+                if (TREE_IS_RED(parent)) {
+                    SET_TREE_RED(sibling);
+                } else {
+                    SET_TREE_BLACK(sibling);
+                }
+                SET_TREE_BLACK(parent);
+                SET_TREE_BLACK(TREE_RIGHT(sibling));
+                tree_rotate_left(parent);
+                child = cur_heap->ftree;
+            }
+        } else {
+            sibling = TREE_LEFT(parent);
+            if (TREE_IS_RED(sibling)) {
+                SET_TREE_BLACK(sibling);
+                SET_TREE_RED(parent);
+                tree_rotate_right(parent);
+                sibling = TREE_LEFT(parent);
+            }
+            if (!TREE_IS_RED(TREE_LEFT(sibling)) && !TREE_IS_RED(TREE_RIGHT(sibling))) {
+                SET_TREE_RED(sibling);
+                child = parent;
+                parent = TREE_PARENT(child);
+            } else {
+                if (!TREE_IS_RED(TREE_LEFT(sibling))) {
+                    SET_TREE_BLACK(TREE_RIGHT(sibling));
+                    SET_TREE_RED(sibling);
+                    tree_rotate_left(sibling);
+                    sibling = TREE_LEFT(parent);
+                }
+                if (TREE_IS_RED(parent)) {
+                    SET_TREE_RED(sibling);
+                } else {
+                    SET_TREE_BLACK(sibling);
+                }
+                SET_TREE_BLACK(parent);
+                SET_TREE_BLACK(TREE_LEFT(sibling));
+                tree_rotate_right(parent);
+                child = cur_heap->ftree;
+            }
+        }
+    }
+    if (child != NULL) {
+        SET_TREE_BLACK(child);
+    }
+}
+
+/**********************************************************
+ * tree_best_fit
+ * Return the smallest free block in the tree that fits asize
+ * (lowest address among equal sizes), or NULL. O(log n)
+ **********************************************************/
+void *tree_best_fit(size_t asize)
+{
+    void *cur = cur_heap->ftree;
+    void *best = NULL;
+
+    while (cur != NULL) {
+        if (GET_SIZE_FROM_BLK(cur) >= asize) {
+            best = cur;
+            cur = TREE_LEFT(cur);
+        } else {
+            cur = TREE_RIGHT(cur);
+        }
+    }
+    return best;
 }
 
 /**********************************************************
  * insert_free_block
  * Insert the free block to the start of the designated linked list 
- * in free block list
- * TODO: Maybe use binary search tree to replace linked list?
+ * in free block list, or into the tree if it is large
  **********************************************************/
 void insert_free_block(void *bp)
 {
     size_t asize = GET_SIZE_FROM_BLK(bp);
     size_t index = get_flist_index(asize);
 
-    printf("Insert free block size = %zu at index = %zu\n", asize / WSIZE, index);
-    fflush(stdout);
+    MM_TRACE_EVENT(MM_EV_INSERT, asize, index, bp);
+    STAT_ADD(bin_bytes[index], asize);
+
+    if (asize >= TREE_MIN_SIZE) {
+        tree_insert(bp);
+        return;
+    }
 
-    void *first_block = flist[index];
+    void *first_block = cur_heap->flist[index];
 
     if (first_block != NULL) {
         /* If list is not empty, insert in front of the first block */
@@ -159,21 +966,45 @@ void insert_free_block(void *bp)
     }
     /* Set the previous block to NULL to identify the first block */
     PUT_PREV_FBLOCK(bp, NULL);
-    flist[index] = bp;
+    cur_heap->flist[index] = bp;
+
+    /* Mark the bin as occupied */
+    cur_heap->sl_bitmap[index / SL_INDEX_COUNT] |= 1u << (index % SL_INDEX_COUNT);
+    cur_heap->fl_bitmap |= 1u << (index / SL_INDEX_COUNT);
 
     //assert(GET_PREV_FBLOCK(bp) == NULL);
 }
 
+/**********************************************************
+ * prefetch_links
+ * Prefetch the list nodes or tree parent linked to the free
+ * block bp, which removing bp writes
+ **********************************************************/
+static inline void prefetch_links(void *bp)
+{
+    if (GET_SIZE_FROM_BLK(bp) < TREE_MIN_SIZE) {
+        PREFETCH_W((char *)GET_PREV_FBLOCK(bp) + WSIZE);
+        PREFETCH_W(GET_NEXT_FBLOCK(bp));
+    } else {
+        PREFETCH_W(TREE_PARENT(bp));
+    }
+}
+
 /**********************************************************
  * remove_free_block
- * Remove the free block from the free block list
- * TODO: Maybe use binary search tree to replace linked list?
+ * Remove the free block from the free block list or tree
  **********************************************************/
 void remove_free_block(void *bp)
 {
     size_t asize = GET_SIZE_FROM_BLK(bp);
-    printf("Remove free block size = %zu\n", asize / WSIZE);
-    fflush(stdout);
+    prefetch_links(bp);
+    MM_TRACE_EVENT(MM_EV_REMOVE, asize, get_flist_index(asize), bp);
+    STAT_ADD(bin_bytes[get_flist_index(asize)], -asize);
+
+    if (asize >= TREE_MIN_SIZE) {
+        tree_remove(bp);
+        return;
+    }
 
     void *prev = GET_PREV_FBLOCK(bp);
     void *next = GET_NEXT_FBLOCK(bp);
@@ -184,7 +1015,14 @@ void remove_free_block(void *bp)
     } else {
         /* bp is the first block */
         size_t index = get_flist_index(asize);
-        flist[index] = next;
+        cur_heap->flist[index] = next;
+        if (next == NULL) {
+            /* The bin is now empty, clear its occupancy bits */
+            size_t fl = index / SL_INDEX_COUNT;
+            cur_heap->sl_bitmap[fl] &= ~(1u << (index % SL_INDEX_COUNT));
+            if (!cur_heap->sl_bitmap[fl])
+                cur_heap->fl_bitmap &= ~(1u << fl);
+        }
     }
     if (next) {
         /* bp is not the last block */
@@ -199,17 +1037,19 @@ void remove_free_block(void *bp)
 
  * After finding a fit block, split the block if the remaining block size
  * is enough for another allocation, and remove the free block from free list.
- * TODO: Maybe use binary search tree to replace linked list?
+ * Only used for list bins, large blocks are found with tree_best_fit.
  **********************************************************/
 void *find_block(size_t index, size_t asize)
 {
-    void *bp = flist[index];
+    void *bp = cur_heap->flist[index];
     size_t block_size;
     /* Loop through the entire bin to find a fit free block */
     while (bp != NULL) {
+        /* Fetch the next node's header while this one is checked */
+        PREFETCH(HDRP(GET_NEXT_FBLOCK(bp)));
         block_size = GET_SIZE_FROM_BLK(bp);
         if (block_size >= asize) {
-            printf("Found fit free block size = %zu at index = %zu\n", block_size / WSIZE, index);
+            MM_TRACE_EVENT(MM_EV_FIT, block_size, index, bp);
             bp = handle_split_block(bp, asize);
             break;
         }
@@ -238,23 +1078,22 @@ void *handle_split_block(void *bp, size_t asize)
     }
 
     /* Do not split if block size is not large enough */
-    if (block_size < asize + MIN_BLOCK_SIZE) {
-        printf("No need to split\n");
+    if (block_size < asize + split_min_size) {
         return bp;
     }
 
-    printf("Splitting %zu into %zu and %zu\n", block_size / WSIZE, asize / WSIZE, sub_size / WSIZE);
-    fflush(stdout);
+    MM_TRACE_EVENT(MM_EV_SPLIT, asize, MM_TRACE_NO_BIN, bp);
+    STAT_ADD(splits, 1);
 
-    /* Change size in header and footer of bp */
+    /* Change size in header of bp, its footer is written by place if needed */
     /* Note that the order cannot be changed here, since all subsequence operations depends on the header */
-    PUT(HDRP(bp), asize);
-    PUT(FTRP(bp), asize);
+    PUT_HDR(bp, asize, 0);
 
-    /* Change size in header and footer of sub block */
+    /* Change size in header and footer of sub block. Its prev-allocated bit
+     * is set by place once bp is marked allocated */
     void *sub_block = NEXT_BLKP(bp);
-    PUT(HDRP(sub_block), sub_size);
-    PUT(FTRP(sub_block), sub_size);
+    PUT(HDRP(sub_block), PACK(sub_size, 0));
+    PUT_FTR(sub_block, sub_size);
 
     /* Insert the sub block back to the free list */
     insert_free_block(sub_block);
@@ -262,6 +1101,232 @@ void *handle_split_block(void *bp, size_t asize)
     return bp;
 }
 
+/* Bulk copy and zero kernels for realloc moves and mm_calloc. Payloads
+ * are 16-byte aligned, so the destination of a bulk operation is too.
+ * On x86-64 the SSE2 or, when the CPU has it, AVX2 version is picked in
+ * mm_init. At least MM_NT_THRESHOLD bytes are written with non-temporal
+ * stores, which bypass the cache: a block that big would only evict
+ * everything else on its way. Less than BULK_MIN_SIZE bytes go to libc,
+ * whose small size paths are hard to beat */
+#ifndef MM_NT_THRESHOLD
+#define MM_NT_THRESHOLD (1 << 20)
+#endif
+#define BULK_MIN_SIZE   4096
+
+static void copy_libc(void *dst, const void *src, size_t n)
+{
+    memcpy(dst, src, n);
+}
+
+static void zero_libc(void *dst, size_t n)
+{
+    memset(dst, 0, n);
+}
+
+void (*bulk_copy_fn)(void *dst, const void *src, size_t n) = copy_libc;
+void (*bulk_zero_fn)(void *dst, size_t n) = zero_libc;
+
+#if defined(__x86_64__)
+/* One 64 or 128 byte step of the kernels below, with store st */
+#define COPY_STEP_SSE2(d, s, st) do { \
+        __m128i a_ = _mm_loadu_si128((const __m128i *)(s)); \
+        __m128i b_ = _mm_loadu_si128((const __m128i *)((s) + 16)); \
+        __m128i c_ = _mm_loadu_si128((const __m128i *)((s) + 32)); \
+        __m128i e_ = _mm_loadu_si128((const __m128i *)((s) + 48)); \
+        st((__m128i *)(d), a_); \
+        st((__m128i *)((d) + 16), b_); \
+        st((__m128i *)((d) + 32), c_); \
+        st((__m128i *)((d) + 48), e_); \
+    } while (0)
+#define ZERO_STEP_SSE2(d, z, st) do { \
+        st((__m128i *)(d), z); \
+        st((__m128i *)((d) + 16), z); \
+        st((__m128i *)((d) + 32), z); \
+        st((__m128i *)((d) + 48), z); \
+    } while (0)
+#define COPY_STEP_AVX2(d, s, st) do { \
+        __m256i a_ = _mm256_loadu_si256((const __m256i *)(s)); \
+        __m256i b_ = _mm256_loadu_si256((const __m256i *)((s) + 32)); \
+        __m256i c_ = _mm256_loadu_si256((const __m256i *)((s) + 64)); \
+        __m256i e_ = _mm256_loadu_si256((const __m256i *)((s) + 96)); \
+        st((__m256i *)(d), a_); \
+        st((__m256i *)((d) + 32), b_); \
+        st((__m256i *)((d) + 64), c_); \
+        st((__m256i *)((d) + 96), e_); \
+    } while (0)
+#define ZERO_STEP_AVX2(d, z, st) do { \
+        st((__m256i *)(d), z); \
+        st((__m256i *)((d) + 32), z); \
+        st((__m256i *)((d) + 64), z); \
+        st((__m256i *)((d) + 96), z); \
+    } while (0)
+
+/**********************************************************
+ * copy_sse2, zero_sse2
+ * 64 bytes per iteration with aligned stores, the tail
+ * through libc. dst is 16-byte aligned
+ **********************************************************/
+static void copy_sse2(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+
+    if (n >= MM_NT_THRESHOLD) {
+        for (; n >= 64; n -= 64, d += 64, s += 64)
+            COPY_STEP_SSE2(d, s, _mm_stream_si128);
+        _mm_sfence();
+    } else {
+        for (; n >= 64; n -= 64, d += 64, s += 64)
+            COPY_STEP_SSE2(d, s, _mm_store_si128);
+    }
+    memcpy(d, s, n);
+}
+
+static void zero_sse2(void *dst, size_t n)
+{
+    char *d = dst;
+    __m128i z = _mm_setzero_si128();
+
+    if (n >= MM_NT_THRESHOLD) {
+        for (; n >= 64; n -= 64, d += 64)
+            ZERO_STEP_SSE2(d, z, _mm_stream_si128);
+        _mm_sfence();
+    } else {
+        for (; n >= 64; n -= 64, d += 64)
+            ZERO_STEP_SSE2(d, z, _mm_store_si128);
+    }
+    memset(d, 0, n);
+}
+
+/**********************************************************
+ * copy_avx2, zero_avx2
+ * 128 bytes per iteration. dst is first brought to 32-byte
+ * alignment with one 16-byte step, so all 32-byte stores,
+ * non-temporal ones included, are aligned
+ **********************************************************/
+__attribute__((target("avx2")))
+static void copy_avx2(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+
+    if ((uintptr_t)d & 31) {
+        _mm_store_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+        d += 16;
+        s += 16;
+        n -= 16;
+    }
+    if (n >= MM_NT_THRESHOLD) {
+        for (; n >= 128; n -= 128, d += 128, s += 128)
+            COPY_STEP_AVX2(d, s, _mm256_stream_si256);
+        _mm_sfence();
+    } else {
+        for (; n >= 128; n -= 128, d += 128, s += 128)
+            COPY_STEP_AVX2(d, s, _mm256_store_si256);
+    }
+    _mm256_zeroupper();
+    memcpy(d, s, n);
+}
+
+__attribute__((target("avx2")))
+static void zero_avx2(void *dst, size_t n)
+{
+    char *d = dst;
+    __m256i z = _mm256_setzero_si256();
+
+    if ((uintptr_t)d & 31) {
+        _mm_store_si128((__m128i *)d, _mm_setzero_si128());
+        d += 16;
+        n -= 16;
+    }
+    if (n >= MM_NT_THRESHOLD) {
+        for (; n >= 128; n -= 128, d += 128)
+            ZERO_STEP_AVX2(d, z, _mm256_stream_si256);
+        _mm_sfence();
+    } else {
+        for (; n >= 128; n -= 128, d += 128)
+            ZERO_STEP_AVX2(d, z, _mm256_store_si256);
+    }
+    _mm256_zeroupper();
+    memset(d, 0, n);
+}
+#endif
+
+/**********************************************************
+ * bulk_init
+ * Pick the copy and zero kernels for this CPU
+ **********************************************************/
+static void bulk_init(void)
+{
+    bulk_zero_fn = zero_libc;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        bulk_copy_fn = copy_avx2;
+        bulk_zero_fn = zero_avx2;
+    } else {
+        bulk_copy_fn = copy_sse2;
+        bulk_zero_fn = zero_sse2;
+    }
+#endif
+}
+
+static inline void bulk_copy(void *dst, const void *src, size_t n)
+{
+    if (n < BULK_MIN_SIZE || ((uintptr_t)dst & (DSIZE - 1)))
+        memcpy(dst, src, n);
+    else
+        bulk_copy_fn(dst, src, n);
+}
+
+static inline void bulk_zero(void *dst, size_t n)
+{
+    if (n < BULK_MIN_SIZE || ((uintptr_t)dst & (DSIZE - 1)))
+        memset(dst, 0, n);
+    else
+        bulk_zero_fn(dst, n);
+}
+
+/**********************************************************
+ * heap_init
+ * Initialize the free block state of heap h, which owns no
+ * memory yet
+ **********************************************************/
+void heap_init(heap_t *h, unsigned id)
+{
+    int i;
+
+    for (i = 0; i < FREE_LIST_SIZE; i ++) {
+        h->flist[i] = NULL;
+    }
+    h->fl_bitmap = 0;
+    for (i = 0; i < FL_INDEX_COUNT; i ++) {
+        h->sl_bitmap[i] = 0;
+    }
+    h->ftree = NULL;
+    for (i = 0; i < SLAB_CLASS_COUNT; i ++) {
+        h->slab_partial[i] = NULL;
+    }
+    for (i = 0; i < QUICK_COUNT; i ++) {
+        h->quick[i] = NULL;
+    }
+    h->quick_bytes = 0;
+    h->grow_size = grow_min_size;
+    h->grow_mark = 0;
+    memset(h->demand, 0, sizeof(h->demand));
+    h->heap_end = NULL;
+    h->region_brk = NULL;
+    h->region_end = NULL;
+    h->fresh = NULL;
+    h->trim_lo = NULL;
+    h->trim_hi = NULL;
+    memset(&h->stats, 0, sizeof(h->stats));
+    h->id = id;
+#ifdef MM_THREADS
+    pthread_mutex_init(&h->lock, NULL);
+#endif
+}
+
 /**********************************************************
  * mm_init
  * Initialize the heap, including "allocation" of the
@@ -273,16 +1338,40 @@ int mm_init(void)
     if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1) return -1;
 
     PUT(heap_listp, 0);                         // alignment padding
-    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1));   // prologue header
+    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1) | PREV_ALLOC_BIT);   // prologue header
     PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1));   // prologue footer
-    PUT(heap_listp + (3 * WSIZE), PACK(0, 1));    // epilogue header
+    PUT(heap_listp + (3 * WSIZE), PACK(0, 1) | PREV_ALLOC_BIT);    // epilogue header
     heap_listp += DSIZE;
 
-    /* Initialize the free block list to be NULL */
-    int i;
-    for (i = 0; i < FREE_LIST_SIZE; i ++) {
-        flist[i] = NULL;
+    /* The first arena owns the initial segment, the others start a
+     * segment of their own on their first extend_heap */
+    unsigned a;
+    for (a = 0; a < ARENA_COUNT; a ++) {
+        heap_init(&arenas[a], a);
+    }
+    arenas[0].heap_end = (char *)heap_listp + DSIZE;
+    cur_heap = &arenas[0];
+
+#ifdef MM_THREADS
+    /* Objects cached by the calling thread belong to the old heap */
+    for (a = 0; a < SLAB_CLASS_COUNT; a ++) {
+        tcache[a].count = 0;
     }
+    for (a = 0; a < ARENA_COUNT; a ++) {
+        remote_free[a].count = 0;
+    }
+    pthread_once(&fork_once, fork_register);
+#endif
+
+#if MM_CHECK_SLICE
+    check_cursor = NULL;
+#endif
+
+    bulk_init();
+
+    memset(slab_map, 0, slab_map_used * sizeof(slab_map[0]));
+    slab_map_used = 0;
+    slab_map_base = (uintptr_t)mem_heap_lo() & ~(uintptr_t)(RUN_SIZE - 1);
 
     return 0;
 }
@@ -296,14 +1385,15 @@ int mm_init(void)
  * - both neighbours are available for coalescing
 
  * Note that after coalescing, the coalesced blocks will be removed from free list,
- * and the new block will be added to free list
+ * and the new block will be added to free list.
+ * The caller has already cleared the prev-allocated bit of the next block
  **********************************************************/
 void *coalesce(void *bp)
 {
     void *new_block;
-    void *prev = (void *) PREV_BLKP(bp);
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    void *prev = prev_alloc ? NULL : (void *) PREV_BLKP(bp);
     void *next = (void *) NEXT_BLKP(bp);
-    size_t prev_alloc = GET_ALLOC(FTRP(prev));
     size_t next_alloc = GET_ALLOC(HDRP(next));
     size_t size = GET_SIZE(HDRP(bp));
 
@@ -311,37 +1401,53 @@ void *coalesce(void *bp)
         return bp;
     }
 
-    printf("Coalescing\n");
+    /* Start the loads of the list nodes both removals will write at once */
+    if (!next_alloc)
+        prefetch_links(next);
+    if (!prev_alloc)
+        prefetch_links(prev);
 
     if (prev_alloc && next_alloc) {       /* Case 1 */
         new_block = bp;
+        MM_TRACE_EVENT(MM_EV_COALESCE, size, 1, new_block);
+        STAT_ADD(coalesces[0], 1);
     }
 
     else if (prev_alloc && !next_alloc) { /* Case 2 */
         /* Need to remove from free list because it is been coalesced */
         remove_free_block(next);
+        CHECK_FORGET(next);
         size += GET_SIZE(HDRP(next));
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size, 0));
+        PUT_HDR(bp, size, 0);
+        PUT_FTR(bp, size);
         new_block = bp;
+        MM_TRACE_EVENT(MM_EV_COALESCE, size, 2, new_block);
+        STAT_ADD(coalesces[1], 1);
     }
 
     else if (!prev_alloc && next_alloc) { /* Case 3 */
         /* Need to remove prev from free list because the size is changed */
         remove_free_block(prev);
+        CHECK_FORGET(bp);
         size += GET_SIZE(HDRP(prev));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        new_block = PREV_BLKP(bp);
+        PUT_HDR(prev, size, 0);
+        PUT_FTR(prev, size);
+        new_block = prev;
+        MM_TRACE_EVENT(MM_EV_COALESCE, size, 3, new_block);
+        STAT_ADD(coalesces[2], 1);
     }
 
     else {            /* Case 4 */
         remove_free_block(prev);
         remove_free_block(next);
-        size += GET_SIZE(HDRP(prev)) + GET_SIZE(FTRP(next))  ;
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size,0));
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size,0));
-        new_block = PREV_BLKP(bp);
+        CHECK_FORGET(bp);
+        CHECK_FORGET(next);
+        size += GET_SIZE(HDRP(prev)) + GET_SIZE(HDRP(next));
+        PUT_HDR(prev, size, 0);
+        PUT_FTR(prev, size);
+        new_block = prev;
+        MM_TRACE_EVENT(MM_EV_COALESCE, size, 4, new_block);
+        STAT_ADD(coalesces[3], 1);
     }
     insert_free_block(new_block);
     return new_block;
@@ -351,7 +1457,10 @@ void *coalesce(void *bp)
  * extend_heap
  * Extend the heap by "words" words, maintaining alignment
  * requirements of course. Free the former epilogue block
- * and reallocate its new header
+ * and reallocate its new header.
+ * If another arena has grown the heap since, the current heap's
+ * segment cannot be extended, so a new segment is started.
+ * Called with sbrk_lock held.
  **********************************************************/
 void *extend_heap(size_t words)
 {
@@ -360,15 +1469,33 @@ void *extend_heap(size_t words)
 
     /* Allocate an even number of words to maintain alignments */
     size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-    if ( (bp = mem_sbrk(size)) == (void *)-1 )
-        return NULL;
 
-    printf("Extend heap size = %zu\n", size / WSIZE);
+    if (cur_heap->heap_end == heap_top()) {
+        if ( (bp = heap_sbrk(size)) == (void *)-1 )
+            return NULL;
+        /* Initialize free block header/footer and the epilogue header.
+         * The old epilogue header becomes the new block's header and already
+         * holds the prev-allocated bit of the last block */
+        PUT_HDR(bp, size, 0);                    // free block header
+    } else {
+        /* New segment: a padding word, then the block, which has
+         * no previous block to coalesce with */
+        if ( (bp = heap_sbrk(size + DSIZE)) == (void *)-1 )
+            return NULL;
+        PUT(bp, 0);                              // alignment padding
+        bp += DSIZE;
+        PUT(HDRP(bp), PACK(size, 0) | PREV_ALLOC_BIT);   // free block header
+    }
+
+    MM_TRACE_EVENT(MM_EV_EXTEND, size, MM_TRACE_NO_BIN, bp);
+    STAT_ADD(extends, 1);
+    STAT_ADD(extend_bytes, size);
 
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));                // free block header
-    PUT(FTRP(bp), PACK(size, 0));                // free block footer
+    PUT_FTR(bp, size);                           // free block footer
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));        // new epilogue header
+    cur_heap->heap_end = NEXT_BLKP(bp);
+    if (cur_heap->fresh != NULL && bp + 3 * WSIZE > cur_heap->fresh)
+        cur_heap->fresh = bp + 3 * WSIZE;        // links of the new block
 
     /* Coalesce if the previous block was free */
     bp = coalesce(bp);
@@ -379,230 +1506,2348 @@ void *extend_heap(size_t words)
 
 /**********************************************************
  * find_fit
- * Starting from the minimum bin index of free list that fits asize, 
- * traverse the list of remaining bins searching for a block to fit asize.
+ * Large requests are served best-fit from the tree.
+ * Otherwise first try the bin asize maps to, whose blocks may be
+ * smaller than asize. Any block in a higher bin fits, so next take
+ * the first block of the next non-empty bin found through the
+ * occupancy bitmaps, and finally the smallest block of the tree.
  * Return NULL if no free blocks can handle that size
  * Assumed that asize is aligned
  **********************************************************/
 void *find_fit(size_t asize)
 {
-    fflush(stdout);
     void *bp = NULL;
-    size_t index;
+    size_t index = get_flist_index(asize);
 
-    /* Loop through all bins with size larger than asize */
-    for (index = get_flist_index(asize); index < FREE_LIST_SIZE; index++) {
-        /* Try to find a fit free block in a bin */
-        bp = find_block(index, asize);
-        if (bp != NULL) {
-            break;
+    if (asize < TREE_MIN_SIZE) {
+        /* Try to find a fit free block in the exact bin */
+        if (cur_heap->flist[index] != NULL) {
+            bp = find_block(index, asize);
+            if (bp != NULL) {
+                return bp;
+            }
+        }
+        index = find_nonempty_bin(index + 1);
+        if (index != FREE_LIST_SIZE) {
+            bp = cur_heap->flist[index];
+            MM_TRACE_EVENT(MM_EV_FIT, GET_SIZE_FROM_BLK(bp), index, bp);
+            return handle_split_block(bp, asize);
         }
     }
 
-    return bp;
+    bp = tree_best_fit(asize);
+    if (bp == NULL) {
+        return NULL;
+    }
+    MM_TRACE_EVENT(MM_EV_FIT, GET_SIZE_FROM_BLK(bp), index, bp);
+    return handle_split_block(bp, asize);
 }
 
 /**********************************************************
  * place
- * Mark the block as allocated
+ * Mark the block as allocated, and tell the next block
  **********************************************************/
 void place(void* bp, size_t asize)
 {
   /* Get the current block size */
   size_t bsize = GET_SIZE(HDRP(bp));
 
-  PUT(HDRP(bp), PACK(bsize, 1));
+  PUT_ALLOC_HDR(bp, bsize);
+#if !FOOTER_ELISION
   PUT(FTRP(bp), PACK(bsize, 1));
+#endif
+  SET_PREV_ALLOC(NEXT_BLKP(bp));
+  trim_touch(bp, bsize);
 }
 
 /**********************************************************
- * mm_free
- * Free the block and coalesce with neighbouring blocks.
- * Add the freed block to free list
- **********************************************************/
-void mm_free(void *bp)
-{
-    if(bp == NULL){
-      return;
-    }
-    /* Clear allocated bit in header and footer, and coalesce freed block */
-    size_t size = GET_SIZE(HDRP(bp));
-
-    printf("Free size = %zu\n", size / WSIZE);
-    fflush(stdout);
-
-    PUT(HDRP(bp), PACK(size,0));
-    PUT(FTRP(bp), PACK(size,0));
-    coalesce(bp);
-
-    print_flist();
-    printf("********************\n");
-    fflush(stdout);
-}
-
-
-/**********************************************************
- * mm_malloc
- * Allocate a block of size bytes.
- * The type of search is determined by find_fit
- * The decision of splitting the block, or not is determined
- *   in place(..)
- * If no block satisfies the request, the heap is extended
- * TODO: When asize > CHUNKSIZE, if the last block is free, 
-         use that free block as well to reduce external fragmentation.
-         eg. extend_heap(asize - last free block size)
-   TODO: Remember to split the extended heap before place
+ * get_free_block
+ * Find a free block for asize, extending the heap if no block
+ * fits. The block is removed from the free list and split,
+ * but not yet marked allocated.
  **********************************************************/
-void *mm_malloc(size_t size)
+void *get_free_block(size_t asize)
 {
-    size_t asize; /* adjusted block size */
     size_t extendsize; /* amount to extend heap if no fit */
     char * bp;
 
-    /* Ignore spurious requests */
-    if (size == 0)
-        return NULL;
-
-    /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1))/ DSIZE);
-
-    printf("Malloc size = %zu\n", asize / WSIZE);
-    fflush(stdout);
-    print_flist();
-
     /* Search the free list for a fit */
     if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize);
-
-        printf("********************\n");
-        fflush(stdout);
-        print_flist();
-
         return bp;
     }
 
-    /* No fit found. Get more memory and place the block */
-    printf("No free block, extending heap\n");
-    fflush(stdout);
-    
-    extendsize = get_extend_size(asize);
+    /* Coalesce the deferred blocks and search again */
+    if (cur_heap->quick_bytes > 0) {
+        quick_consolidate();
+        if ((bp = find_fit(asize)) != NULL) {
+            return bp;
+        }
+    }
 
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+    /* No fit found. Get more memory */
+    SBRK_LOCK();
+    extendsize = get_extend_size(asize);
+    bp = extend_heap(extendsize/WSIZE);
+    SBRK_UNLOCK();
+    if (bp == NULL)
         return NULL;
     
     size_t block_size = GET_SIZE(HDRP(bp));
 
-    /* TODO: tune the number? */
-    if (block_size >= asize + 0) {
+    /* Keep a surplus below fit_slack with the block */
+    if (block_size >= asize + fit_slack) {
         bp = handle_split_block(bp, asize);
+    } else {
+        remove_free_block(bp);
+    }
+    /* Pre-split the surplus only if the growth step made one */
+    if (PRESPLIT_MAX_SIZE && extendsize > asize) {
+        presplit(NEXT_BLKP(bp));
     }
-    
-    place(bp, asize);
-
-    printf("bp size = %zu\n", block_size / WSIZE);
-    printf("********************\n");
-    fflush(stdout);
-    print_flist();
-
     return bp;
 }
 
-
-size_t get_extend_size(size_t asize)
+/**********************************************************
+ * presplit
+ * Carve blocks of the size most requested since the last
+ * extension off the front of the free block bp, the surplus of
+ * an extension, and push them on the quick lists. At most half
+ * of bp and no more blocks than were requested are carved.
+ * The demand counts are halved, so older requests fade out
+ **********************************************************/
+void presplit(void *bp)
 {
-    size_t extendsize;
-
-    if (asize * 2 < CHUNKSIZE) {
-        /* If asize is too small, don't allocate that much memory */
-        extendsize = asize;
-    } else {
-        extendsize = MAX(CHUNKSIZE, asize);
+    heap_t *h = cur_heap;
+    size_t size = GET_SIZE_FROM_BLK(bp);
+    size_t i, hot = 0, csize, n;
+    char *p;
+
+    if (GET_ALLOC(HDRP(bp)))
+        return;
+    for (i = 0; i < DEMAND_COUNT; i ++) {
+        if (h->demand[i] > h->demand[hot])
+            hot = i;
     }
+    n = h->demand[hot];
+    for (i = 0; i < DEMAND_COUNT; i ++) {
+        h->demand[i] >>= 1;
+    }
+
+    csize = MIN_BLOCK_SIZE + hot * DSIZE;
+    if (n > size / 2 / csize)
+        n = size / 2 / csize;
+    if (n == 0)
+        return;
+
+    remove_free_block(bp);
+    trim_touch(bp, n * csize);
+    for (i = 0, p = bp; i < n; i ++, p += csize) {
+        /* Marked allocated like a deferred block */
+        if (i > 0)
+            PUT(HDRP(p), PREV_ALLOC_BIT);
+        PUT_ALLOC_HDR(p, csize);
+#if !FOOTER_ELISION
+        PUT(FTRP(p), PACK(csize, 1));
+#endif
+        PUT_QUICK_NEXT(p, h->quick[hot]);
+        h->quick[hot] = p;
+    }
+    h->quick_bytes += n * csize;
+
+    /* The rest stays free, at least half of bp */
+    size -= n * csize;
+    PUT(HDRP(p), PACK(size, 0) | PREV_ALLOC_BIT);
+    PUT_FTR(p, size);
+    insert_free_block(p);
+}
+
+/**********************************************************
+ * aligned_payload
+ * First payload address in the free block bp aligned to align
+ * that leaves either no leading padding or enough for a free
+ * block
+ **********************************************************/
+static inline char *aligned_payload(char *bp, size_t align)
+{
+    char *aligned = (char *)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+    if (aligned != bp && (size_t)(aligned - bp) < MIN_BLOCK_SIZE)
+        aligned += align;
+    return aligned;
+}
+
+/**********************************************************
+ * find_aligned_fit
+ * First free block in the bins, from the one asize maps to
+ * up, that holds asize bytes at an aligned payload, looking at
+ * no more than ALIGN_SCAN blocks per bin. Large blocks come
+ * from the tree, which must then hold the worst case padding.
+ * The block is removed from the free list but not split.
+ * Return NULL if none is found
+ **********************************************************/
+void *find_aligned_fit(size_t align, size_t asize)
+{
+    size_t index;
+    char *bp;
+    int n;
+
+    if (asize < TREE_MIN_SIZE) {
+        for (index = find_nonempty_bin(get_flist_index(asize)); index != FREE_LIST_SIZE;
+             index = find_nonempty_bin(index + 1)) {
+            for (bp = cur_heap->flist[index], n = 0; bp != NULL && n < ALIGN_SCAN;
+                 bp = GET_NEXT_FBLOCK(bp), n ++) {
+                if (aligned_payload(bp, align) - bp + asize <= GET_SIZE_FROM_BLK(bp)) {
+                    remove_free_block(bp);
+                    return bp;
+                }
+            }
+        }
+    }
+
+    bp = tree_best_fit(asize + align + MIN_BLOCK_SIZE);
+    if (bp != NULL)
+        remove_free_block(bp);
+    return bp;
+}
+
+/**********************************************************
+ * alloc_aligned_block
+ * Allocate a block of asize bytes whose payload is aligned to
+ * align (a power of two, larger than DSIZE). A free block that
+ * fits at an aligned payload is taken, or else a block with
+ * room for any padding, and the padding in front of the
+ * aligned payload and any tail are split off and freed again.
+ **********************************************************/
+void *alloc_aligned_block(size_t align, size_t asize)
+{
+    char *bp = find_aligned_fit(align, asize);
+    char *aligned;
+
+    if (bp == NULL)
+        bp = get_free_block(asize + align + MIN_BLOCK_SIZE);
+    if (bp == NULL)
+        return NULL;
+
+    aligned = aligned_payload(bp, align);
+    if (aligned != bp) {
+        size_t block_size = GET_SIZE_FROM_BLK(bp);
+        size_t lead = aligned - bp;
+
+        /* The padding becomes a free block of its own; its previous block
+         * is allocated since bp came off the free list */
+        PUT_HDR(bp, lead, 0);
+        PUT_FTR(bp, lead);
+        PUT(HDRP(aligned), PACK(block_size - lead, 0));
+        insert_free_block(bp);
+        bp = aligned;
+    }
+
+    place(bp, asize);
+    realloc_split_tail(bp, asize);
+    return bp;
+}
+
+/**********************************************************
+ * slab_class
+ * Size class index for a small request
+ **********************************************************/
+static inline size_t slab_class(size_t size)
+{
+    if (size <= 128)
+        return (size - 1) / 16;
+    return 8 + (size - 129) / 32;
+}
+
+static inline size_t slab_class_size(size_t sclass)
+{
+    if (sclass < 8)
+        return (sclass + 1) * 16;
+    return 128 + (sclass - 7) * 32;
+}
+
+/**********************************************************
+ * slab_is_run
+ * Return nonzero if ptr lies in a slab run
+ **********************************************************/
+static inline int slab_is_run(void *ptr)
+{
+    size_t index = ((uintptr_t)ptr - slab_map_base) >> RUN_SHIFT;
+    return index < SLAB_MAP_RUNS &&
+        (__atomic_load_n(&slab_map[index / 64], __ATOMIC_ACQUIRE) >> (index % 64)) & 1;
+}
+
+static inline void slab_unlink(slab_run_t *run)
+{
+    if (run->prev)
+        run->prev->next = run->next;
+    else
+        run->heap->slab_partial[run->sclass] = run->next;
+    if (run->next)
+        run->next->prev = run->prev;
+}
+
+static inline void slab_push(slab_run_t *run)
+{
+    run->prev = NULL;
+    run->next = run->heap->slab_partial[run->sclass];
+    if (run->next)
+        run->next->prev = run;
+    run->heap->slab_partial[run->sclass] = run;
+}
+
+/**********************************************************
+ * slab_new_run
+ * Carve a new RUN_SIZE aligned run for a size class out of the
+ * general heap and register it in the run map.
+ * The run is a block of exactly RUN_SIZE bytes, so adjacent runs
+ * pack back to back; the last BLOCK_OVERHEAD bytes of the run
+ * hold the next block's header (and the run's footer) and are
+ * not used for objects.
+ **********************************************************/
+slab_run_t *slab_new_run(size_t sclass)
+{
+    slab_run_t *run = alloc_aligned_block(RUN_SIZE, RUN_SIZE);
+    size_t obj_size = slab_class_size(sclass);
+    size_t header = (sizeof(slab_run_t) + DSIZE - 1) & ~(DSIZE - 1);
+    size_t index, i;
+
+    if (run == NULL)
+        return NULL;
+
+    index = ((uintptr_t)run - slab_map_base) >> RUN_SHIFT;
+    if (index >= SLAB_MAP_RUNS) {
+        /* Out of the range the run map covers */
+        free_block(run);
+        return NULL;
+    }
+    __atomic_fetch_or(&slab_map[index / 64], (uint64_t)1 << (index % 64), __ATOMIC_RELEASE);
+    i = __atomic_load_n(&slab_map_used, __ATOMIC_RELAXED);
+    while (index / 64 + 1 > i &&
+           !__atomic_compare_exchange_n(&slab_map_used, &i, index / 64 + 1, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+
+    run->heap = cur_heap;
+    run->objs = (char *)run + header;
+    run->obj_size = obj_size;
+    run->nobjs = (RUN_SIZE - BLOCK_OVERHEAD - header) / obj_size;
+    run->nfree = run->nobjs;
+    run->sclass = sclass;
+    for (i = 0; i < RUN_MAP_WORDS; i++) {
+        size_t first = i * 64;
+        if (first + 64 <= run->nobjs)
+            run->free_map[i] = ~(uint64_t)0;
+        else if (first < run->nobjs)
+            run->free_map[i] = ((uint64_t)1 << (run->nobjs - first)) - 1;
+        else
+            run->free_map[i] = 0;
+    }
+    slab_push(run);
+
+    MM_TRACE_EVENT(MM_EV_RUN_NEW, obj_size, sclass, run);
+    return run;
+}
+
+/**********************************************************
+ * slab_alloc
+ * Allocate a small object from the first run of its class
+ * that has a free slot. Return NULL if no run can be carved
+ **********************************************************/
+void *slab_alloc(size_t size)
+{
+    size_t sclass = slab_class(size);
+    slab_run_t *run = cur_heap->slab_partial[sclass];
+    size_t i, slot;
+
+    if (run == NULL && (run = slab_new_run(sclass)) == NULL)
+        return NULL;
+
+    for (i = 0; run->free_map[i] == 0; i++)
+        ;
+    slot = i * 64 + __builtin_ctzll(run->free_map[i]);
+    run->free_map[i] &= run->free_map[i] - 1;
+    if (--run->nfree == 0)
+        slab_unlink(run);
+
+    MM_TRACE_EVENT(MM_EV_MALLOC, run->obj_size, sclass, run->objs + slot * run->obj_size);
+    STAT_ADD(live_bytes, run->obj_size);
+    return run->objs + slot * run->obj_size;
+}
+
+/**********************************************************
+ * slab_free
+ * Return a small object to its run, found by masking the
+ * address. A run that becomes empty goes back to the general
+ * heap unless it is the only run of its class with free slots.
+ * Called with the lock of the run's heap held
+ **********************************************************/
+void slab_free(void *ptr)
+{
+    slab_run_t *run = RUN_OF(ptr);
+    size_t slot = ((char *)ptr - run->objs) / run->obj_size;
+
+    MM_TRACE_EVENT(MM_EV_FREE, run->obj_size, run->sclass, ptr);
+    STAT_ADD(live_bytes, -(size_t)run->obj_size);
+    STAT_ADD(frees, 1);
+
+    run->free_map[slot / 64] |= (uint64_t)1 << (slot % 64);
+    if (run->nfree++ == 0)
+        slab_push(run);
+
+    if (run->nfree == run->nobjs &&
+        (run->heap->slab_partial[run->sclass] != run || run->next != NULL)) {
+        size_t index = ((uintptr_t)run - slab_map_base) >> RUN_SHIFT;
+        MM_TRACE_EVENT(MM_EV_RUN_RELEASE, run->obj_size, run->sclass, run);
+        slab_unlink(run);
+        __atomic_fetch_and(&slab_map[index / 64], ~((uint64_t)1 << (index % 64)), __ATOMIC_RELEASE);
+        free_block(run);
+    }
+}
+
+/**********************************************************
+ * mmap_alloc
+ * Serve a huge request from a fresh anonymous mapping, rounded
+ * up to whole pages. No heap lock is needed
+ **********************************************************/
+void *mmap_alloc(size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t len;
+    char *base;
+
+    if (size > SIZE_MAX - MMAP_HDR_SIZE - page)
+        return NULL;
+    len = (size + MMAP_HDR_SIZE + page - 1) & ~(page - 1);
+
+    base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    PUT(base, len);
+    PUT(base + WSIZE, PACK(0, ALLOC_BIT));
+    STAT_ATOMIC_ADD(mmap_bytes, len);
+    STAT_ATOMIC_ADD(mmap_blocks, 1);
+
+    MM_TRACE_EVENT(MM_EV_MMAP, len, MM_TRACE_NO_BIN, base + MMAP_HDR_SIZE);
+    return base + MMAP_HDR_SIZE;
+}
+
+/**********************************************************
+ * mmap_free
+ * Return a mapped block to the system
+ **********************************************************/
+void mmap_free(void *bp)
+{
+    MM_TRACE_EVENT(MM_EV_MUNMAP, MMAP_LEN(bp), MM_TRACE_NO_BIN, bp);
+    STAT_ATOMIC_ADD(mmap_bytes, -MMAP_LEN(bp));
+    STAT_ATOMIC_ADD(mmap_blocks, -1);
+    munmap(MMAP_BASE(bp), MMAP_LEN(bp));
+}
+
+/**********************************************************
+ * mmap_realloc
+ * Resize a mapped block with mremap, which moves the pages
+ * instead of copying the data when the mapping cannot grow
+ * where it is. Return NULL (bp untouched) on failure
+ **********************************************************/
+void *mmap_realloc(void *bp, size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t old_len = MMAP_LEN(bp);
+    size_t offset = (char *)bp - MMAP_BASE(bp);
+    size_t len;
+    char *base;
+
+    if (size > SIZE_MAX - offset - page)
+        return NULL;
+    len = (size + offset + page - 1) & ~(page - 1);
+    if (len == old_len)
+        return bp;
+
+    /* The offset in the mapping is kept, the alignment beyond a page
+     * may be lost if the mapping moves */
+    base = mremap(MMAP_BASE(bp), old_len, len, MREMAP_MAYMOVE);
+    if (base == MAP_FAILED)
+        return NULL;
+    PUT(base + offset - MMAP_HDR_SIZE, len);
+    STAT_ATOMIC_ADD(mmap_bytes, len - old_len);
+
+    MM_TRACE_EVENT(MM_EV_MMAP, len, MM_TRACE_NO_BIN, base + offset);
+    return base + offset;
+}
+
+/**********************************************************
+ * mmap_memalign
+ * mmap_alloc with the payload aligned to align. Up to a page
+ * the payload starts align bytes into the mapping. Beyond, an
+ * extra align bytes are mapped and the pages around the one
+ * holding the header and the payload after it are unmapped
+ **********************************************************/
+void *mmap_memalign(size_t align, size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t offset = align <= page ? align : page;
+    size_t extra = align <= page ? 0 : align - page;
+    size_t len;
+    char *raw, *base, *bp;
+
+    if (size > SIZE_MAX - offset - page - extra)
+        return NULL;
+    len = (size + offset + page - 1) & ~(page - 1);
+
+    raw = mmap(NULL, len + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return NULL;
+    bp = (char *)(((uintptr_t)raw + offset + align - 1) & ~(uintptr_t)(align - 1));
+    base = bp - offset;
+    if (base > raw)
+        munmap(raw, base - raw);
+    if (raw + len + extra > base + len)
+        munmap(base + len, raw + len + extra - (base + len));
+
+    PUT(bp - MMAP_HDR_SIZE, len);
+    PUT(HDRP(bp), PACK(0, ALLOC_BIT));
+    STAT_ATOMIC_ADD(mmap_bytes, len);
+    STAT_ATOMIC_ADD(mmap_blocks, 1);
+
+    MM_TRACE_EVENT(MM_EV_MMAP, len, MM_TRACE_NO_BIN, bp);
+    return bp;
+}
+
+#ifdef MM_THREADS
+/**********************************************************
+ * get_thread_heap
+ * Arena of the calling thread, assigned round robin on first use
+ **********************************************************/
+static inline heap_t *get_thread_heap(void)
+{
+    if (thread_heap == NULL) {
+        unsigned a = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED);
+        thread_heap = &arenas[a % ARENA_COUNT];
+    }
+    return thread_heap;
+}
+
+/**********************************************************
+ * tcache_flush
+ * Give the oldest n objects of a thread cache bin back to
+ * their runs, taking each owning arena's lock once for the
+ * whole batch
+ **********************************************************/
+void tcache_flush(tcache_bin_t *tc, unsigned n)
+{
+    unsigned a, i;
+
+    for (a = 0; a < ARENA_COUNT; a ++) {
+        heap_t *h = &arenas[a];
+        int locked = 0;
+        for (i = 0; i < n; i ++) {
+            if (RUN_OF(tc->slots[i])->heap != h)
+                continue;
+            if (!locked) {
+                HEAP_ENTER(h);
+                locked = 1;
+            }
+            slab_free(tc->slots[i]);
+        }
+        if (locked)
+            HEAP_LEAVE(h);
+    }
+    memmove(tc->slots, tc->slots + n, (tc->count - n) * sizeof(void *));
+    tc->count -= n;
+}
+
+/**********************************************************
+ * remote_flush
+ * Free the general blocks queued for arena a under one
+ * acquisition of its lock
+ **********************************************************/
+static void remote_flush(unsigned a)
+{
+    remote_bin_t *rb = &remote_free[a];
+    unsigned i;
+
+    HEAP_ENTER(&arenas[a]);
+    for (i = 0; i < rb->count; i ++) {
+        heap_free(rb->slots[i]);
+    }
+    HEAP_LEAVE(&arenas[a]);
+    rb->count = 0;
+}
+
+static void tcache_destroy(void *arg)
+{
+    unsigned i;
+    (void)arg;
+    for (i = 0; i < SLAB_CLASS_COUNT; i ++) {
+        tcache_flush(&tcache[i], tcache[i].count);
+    }
+    for (i = 0; i < ARENA_COUNT; i ++) {
+        if (remote_free[i].count > 0)
+            remote_flush(i);
+    }
+}
+
+static void tcache_make_key(void)
+{
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/* Flush the caches of the calling thread when it exits */
+static inline void tcache_register(void)
+{
+    if (!tcache_registered) {
+        pthread_once(&tcache_key_once, tcache_make_key);
+        pthread_setspecific(tcache_key, tcache);
+        tcache_registered = 1;
+    }
+}
+
+/**********************************************************
+ * tcache_put
+ * Cache a freed slab object in the calling thread. A full bin
+ * first sends half of its objects back to their arenas
+ **********************************************************/
+static inline void tcache_put(void *ptr)
+{
+    tcache_bin_t *tc = &tcache[RUN_OF(ptr)->sclass];
+
+    tcache_register();
+    if (tc->count == TCACHE_COUNT) {
+        tcache_flush(tc, TCACHE_COUNT / 2);
+    }
+    tc->slots[tc->count++] = ptr;
+}
+
+/**********************************************************
+ * remote_put
+ * Queue a general block of arena h, which is not the calling
+ * thread's, to be freed with the others of h once REMOTE_COUNT
+ * of them are waiting
+ **********************************************************/
+static inline void remote_put(heap_t *h, void *bp)
+{
+    remote_bin_t *rb = &remote_free[h->id];
+
+    tcache_register();
+    rb->slots[rb->count++] = bp;
+    if (rb->count == REMOTE_COUNT)
+        remote_flush(h->id);
+}
+
+/**********************************************************
+ * fork_prepare, fork_parent, fork_child
+ * Hold every arena lock and sbrk_lock across fork, in the
+ * order the allocator takes them, so that the child does not
+ * inherit a lock held by a thread it does not have. The
+ * child starts over with fresh locks. Locks of heaps made by
+ * mm_heap_create are not covered
+ **********************************************************/
+static void fork_prepare(void)
+{
+    unsigned a;
+    for (a = 0; a < ARENA_COUNT; a ++) {
+        MM_LOCK(&arenas[a].lock);
+    }
+    SBRK_LOCK();
+}
+
+static void fork_parent(void)
+{
+    unsigned a;
+    SBRK_UNLOCK();
+    for (a = 0; a < ARENA_COUNT; a ++) {
+        MM_UNLOCK(&arenas[a].lock);
+    }
+}
+
+static void fork_child(void)
+{
+    unsigned a;
+    pthread_mutex_init(&sbrk_lock, NULL);
+    for (a = 0; a < ARENA_COUNT; a ++) {
+        pthread_mutex_init(&arenas[a].lock, NULL);
+    }
+}
+
+static void fork_register(void)
+{
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+#else
+#define get_thread_heap()   (&arenas[0])
+#endif
+
+/**********************************************************
+ * general_free
+ * Free an allocated general block in the arena that owns it.
+ * A block of another thread's arena is queued and freed in a
+ * batch with others of that arena
+ **********************************************************/
+static inline void general_free(void *bp)
+{
+    heap_t *h = HEAP_OF(bp);
+
+#ifdef MM_THREADS
+    if (h != thread_heap) {
+        remote_put(h, bp);
+        return;
+    }
+#endif
+    HEAP_ENTER(h);
+    heap_free(bp);
+    HEAP_LEAVE(h);
+}
+
+/**********************************************************
+ * mm_free
+ * Free a slab object, or a general block, in the heap that
+ * owns it. Mapped blocks are unmapped
+ **********************************************************/
+void mm_free(void *bp)
+{
+    if(bp == NULL){
+      return;
+    }
+    if (slab_is_run(bp)) {
+#ifdef MM_THREADS
+        tcache_put(bp);
+#else
+        heap_t *h = RUN_OF(bp)->heap;
+        HEAP_ENTER(h);
+        slab_free(bp);
+        HEAP_LEAVE(h);
+#endif
+        return;
+    }
+    if (IS_MMAPPED(bp)) {
+        mmap_free(bp);
+        return;
+    }
+    general_free(bp);
+}
+
+/**********************************************************
+ * mm_free_sized
+ * mm_free a block whose requested size is known to the caller.
+ * The size tells general blocks apart from slab objects
+ * without the slab map lookup, and the next block's tag is
+ * prefetched before the header is read
+ **********************************************************/
+void mm_free_sized(void *bp, size_t size)
+{
+    if (bp == NULL)
+        return;
+    if (size <= SLAB_MAX_SIZE) {
+        mm_free(bp);
+        return;
+    }
+    PREFETCH_W(HDRP(bp) + get_adjusted_size(size));
+    /* A realloc with headroom may have moved a smaller block to a mapping */
+    if (IS_MMAPPED(bp)) {
+        mmap_free(bp);
+        return;
+    }
+    general_free(bp);
+}
+
+/**********************************************************
+ * mm_usable_size
+ * Bytes of the block at ptr the caller may use, at least the
+ * size it asked for. 0 for NULL
+ **********************************************************/
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    if (slab_is_run(ptr))
+        return RUN_OF(ptr)->obj_size;
+    if (IS_MMAPPED(ptr))
+        return MMAP_LEN(ptr) - ((char *)ptr - MMAP_BASE(ptr));
+    return GET_SIZE_FROM_BLK(ptr) - BLOCK_OVERHEAD;
+}
+
+/**********************************************************
+ * heap_free
+ * Free the allocated general block bp of the current heap,
+ * or defer it on a quick list
+ **********************************************************/
+void heap_free(void *bp)
+{
+    STAT_ADD(frees, 1);
+    STAT_ADD(live_bytes, -GET_SIZE_FROM_BLK(bp));
+    if (QUICK_MAX_SIZE && GET_SIZE_FROM_BLK(bp) <= QUICK_MAX_SIZE) {
+        /* Defer coalescing, keep the block for a malloc of the same size */
+        size_t index = QUICK_INDEX(GET_SIZE_FROM_BLK(bp));
+        MM_TRACE_EVENT(MM_EV_FREE, GET_SIZE_FROM_BLK(bp), MM_TRACE_NO_BIN, bp);
+        PUT_QUICK_NEXT(bp, cur_heap->quick[index]);
+        cur_heap->quick[index] = bp;
+        cur_heap->quick_bytes += GET_SIZE_FROM_BLK(bp);
+    } else {
+        free_block(bp);
+    }
+}
+
+/**********************************************************
+ * free_block
+ * Free the block and coalesce with neighbouring blocks.
+ * Add the freed block to free list
+ **********************************************************/
+void free_block(void *bp)
+{
+    /* Clear allocated bit in header and footer, and coalesce freed block */
+    size_t size = GET_SIZE(HDRP(bp));
+
+    MM_TRACE_EVENT(MM_EV_FREE, size, MM_TRACE_NO_BIN, bp);
+
+    PUT_HDR(bp, size, 0);
+    PUT_FTR(bp, size);
+    CLR_PREV_ALLOC(NEXT_BLKP(bp));
+    bp = coalesce(bp);
+
+    /* The top of the heap is free, give its pages back if it got big */
+    if (trim_threshold != 0 && NEXT_BLKP(bp) == cur_heap->heap_end)
+        trim_top(bp);
+    CHECK_STEP(bp);
+}
+
+/**********************************************************
+ * quick_sort
+ * Sort a list of deferred blocks by address (merge sort on
+ * the links, no extra memory)
+ **********************************************************/
+static void *quick_sort(void *list)
+{
+    void *slow = list, *fast, *second, *head = NULL, **tail = &head;
+
+    if (list == NULL || QUICK_NEXT(list) == NULL)
+        return list;
+
+    /* Split in halves */
+    for (fast = QUICK_NEXT(list); fast != NULL && QUICK_NEXT(fast) != NULL;
+         fast = QUICK_NEXT(QUICK_NEXT(fast)))
+        slow = QUICK_NEXT(slow);
+    second = QUICK_NEXT(slow);
+    PUT_QUICK_NEXT(slow, NULL);
+
+    list = quick_sort(list);
+    second = quick_sort(second);
+    while (list != NULL && second != NULL) {
+        void **from = list < second ? &list : &second;
+        *tail = *from;
+        tail = (void **)*from;
+        *from = QUICK_NEXT(*from);
+    }
+    *tail = list != NULL ? list : second;
+    return head;
+}
+
+/**********************************************************
+ * quick_consolidate
+ * Free every deferred block of the current heap, lowest
+ * address first, so the sweep runs forward through memory
+ * and each block merges with the ones freed just before it
+ **********************************************************/
+void quick_consolidate(void)
+{
+    void *list = NULL, *bp, *next;
+    size_t i;
+
+    for (i = 0; i < QUICK_COUNT; i ++) {
+        for (bp = cur_heap->quick[i]; bp != NULL; bp = next) {
+            next = QUICK_NEXT(bp);
+            PUT_QUICK_NEXT(bp, list);
+            list = bp;
+        }
+        cur_heap->quick[i] = NULL;
+    }
+    cur_heap->quick_bytes = 0;
+
+    for (bp = quick_sort(list); bp != NULL; bp = next) {
+        next = QUICK_NEXT(bp);
+        free_block(bp);
+    }
+}
+
+/**********************************************************
+ * free_page_range
+ * The whole pages inside the free block bp that can be
+ * released: past its first pad payload bytes and tree node,
+ * and before its footer. Empty if hi <= lo
+ **********************************************************/
+static inline void free_page_range(void *bp, size_t pad, char **lo, char **hi)
+{
+    uintptr_t page = mem_pagesize();
+    *lo = (char *)(((uintptr_t)bp + 3 * WSIZE + pad + page - 1) & ~(page - 1));
+    *hi = (char *)((uintptr_t)FTRP(bp) & ~(page - 1));
+}
+
+/**********************************************************
+ * release_pages
+ * Give the pages of [lo, lo + len) back to the system. They
+ * stay mapped and fault back in zeroed. Pages of the memlib
+ * heap go through the backend's decommit hook if it has one
+ **********************************************************/
+static inline int release_pages(char *lo, size_t len)
+{
+    if (mem_decommit != NULL && cur_heap->region_end == NULL) {
+        mem_decommit(lo, len);
+        return 0;
+    }
+    return madvise(lo, len, MADV_DONTNEED);
+}
+
+/**********************************************************
+ * trim_top
+ * Release the pages of bp, the last block of the current heap,
+ * once at least trim_threshold bytes of them are not released
+ * yet. Re-advising released pages is cheap but still a system
+ * call, hence the threshold on the new part only
+ **********************************************************/
+void trim_top(void *bp)
+{
+    heap_t *h = cur_heap;
+    char *lo, *hi;
+    size_t known = 0;
+
+    free_page_range(bp, 0, &lo, &hi);
+    if (hi <= lo)
+        return;
+    if (h->trim_lo >= lo && h->trim_hi <= hi && h->trim_lo < h->trim_hi)
+        known = h->trim_hi - h->trim_lo;
+    if ((size_t)(hi - lo) - known < trim_threshold)
+        return;
+
+    MM_TRACE_EVENT(MM_EV_TRIM, hi - lo, MM_TRACE_NO_BIN, bp);
+    release_pages(lo, hi - lo);
+    h->trim_lo = lo;
+    h->trim_hi = hi;
+}
+
+/**********************************************************
+ * trim_tree
+ * Release the pages of every free block in the subtree at bp,
+ * keeping pad bytes of the top block resident. Return the
+ * number of bytes released
+ **********************************************************/
+size_t trim_tree(void *bp, void *top, size_t pad)
+{
+    char *lo, *hi;
+    size_t released;
+
+    if (bp == NULL)
+        return 0;
+    released = trim_tree(TREE_LEFT(bp), top, pad) + trim_tree(TREE_RIGHT(bp), top, pad);
+
+    free_page_range(bp, bp == top ? pad : 0, &lo, &hi);
+    if (hi > lo && release_pages(lo, hi - lo) == 0) {
+        MM_TRACE_EVENT(MM_EV_TRIM, hi - lo, MM_TRACE_NO_BIN, bp);
+        released += hi - lo;
+        if (bp == top) {
+            cur_heap->trim_lo = lo;
+            cur_heap->trim_hi = hi;
+        }
+    }
+    return released;
+}
+
+/**********************************************************
+ * mm_trim
+ * Release the pages of all large free blocks in every heap,
+ * keeping pad bytes at the top of each heap resident.
+ * Return 1 if any memory was released
+ **********************************************************/
+int mm_trim(size_t pad)
+{
+    size_t released = 0;
+    unsigned a;
+
+    for (a = 0; a < ARENA_COUNT; a ++) {
+        heap_t *h = &arenas[a];
+        void *top = NULL;
+        HEAP_ENTER(h);
+        if (h->quick_bytes > 0)
+            quick_consolidate();
+        if (h->heap_end != NULL && !GET_PREV_ALLOC(HDRP(h->heap_end)))
+            top = PREV_BLKP(h->heap_end);
+        released += trim_tree(h->ftree, top, pad);
+        HEAP_LEAVE(h);
+    }
+    return released > 0;
+}
+
+/**********************************************************
+ * mm_get_params
+ * The current tuning parameters
+ **********************************************************/
+void mm_get_params(mm_params_t *p)
+{
+    p->split_min = split_min_size;
+    p->fit_slack = fit_slack;
+    p->realloc_headroom = realloc_headroom;
+    p->grow_min = grow_min_size;
+    p->grow_max = grow_max_size;
+    p->grow_shift = grow_heap_shift;
+    p->trim_threshold = trim_threshold;
+}
+
+/**********************************************************
+ * mm_set_params
+ * Replace the tuning parameters. Returns -1 and changes
+ * nothing if one is out of range: split_min must be a block
+ * size, grow_min a positive multiple of DSIZE no larger than
+ * a nonzero grow_max. Meant to be called between runs, with
+ * no other thread in the allocator
+ **********************************************************/
+int mm_set_params(const mm_params_t *p)
+{
+    if (p->split_min < MIN_BLOCK_SIZE || p->split_min % DSIZE != 0 ||
+        p->grow_min == 0 || p->grow_min % DSIZE != 0 ||
+        (p->grow_max != 0 && p->grow_max < p->grow_min) ||
+        p->grow_shift >= 8 * sizeof(size_t) || p->realloc_headroom > 1000)
+        return -1;
+
+    split_min_size = p->split_min;
+    fit_slack = p->fit_slack;
+    realloc_headroom = p->realloc_headroom;
+    grow_min_size = p->grow_min;
+    grow_max_size = p->grow_max;
+    grow_heap_shift = p->grow_shift;
+    trim_threshold = p->trim_threshold;
+    return 0;
+}
+
+
+/**********************************************************
+ * mm_malloc
+ * Allocate a block of size bytes from the thread cache, or
+ * else from the calling thread's arena. Huge requests get a
+ * mapping of their own
+ **********************************************************/
+void *mm_malloc(size_t size)
+{
+    heap_t *h;
+    void *bp;
+
+    /* Ignore spurious requests */
+    if (size == 0)
+        return NULL;
+
+#ifdef MM_THREADS
+    if (size <= SLAB_MAX_SIZE) {
+        tcache_bin_t *tc = &tcache[slab_class(size)];
+        if (tc->count > 0)
+            return tc->slots[--tc->count];
+    }
+#endif
+
+    if (mmap_threshold != 0 && size >= mmap_threshold)
+        return mmap_alloc(size);
+
+    h = get_thread_heap();
+    HEAP_ENTER(h);
+    bp = heap_malloc(size);
+    HEAP_LEAVE(h);
+    return bp;
+}
+
+/**********************************************************
+ * heap_malloc
+ * Allocate a block of size bytes in the current heap.
+ * Small requests are served by the slab runs, except in a
+ * created heap, whose blocks slab_map does not cover.
+ * Otherwise the type of search is determined by find_fit
+ * The decision of splitting the block, or not is determined
+ *   in handle_split_block(..)
+ * If no block satisfies the request, the heap is extended
+ **********************************************************/
+void *heap_malloc(size_t size)
+{
+    size_t asize; /* adjusted block size */
+    char * bp;
+
+    if (size <= SLAB_MAX_SIZE && cur_heap->region_end == NULL &&
+        (bp = slab_alloc(size)) != NULL) {
+        STAT_ADD(mallocs, 1);
+        STAT_ADD(requested_bytes, size);
+        STAT_ADD(allocated_bytes, RUN_OF(bp)->obj_size);
+        return bp;
+    }
+
+    /* Adjust block size to include overhead and alignment reqs. */
+    asize = get_adjusted_size(size);
+
+    if (PRESPLIT_MAX_SIZE && asize <= PRESPLIT_MAX_SIZE) {
+        cur_heap->demand[QUICK_INDEX(asize)] ++;
+    }
+    if (QUICK_LIMIT && asize <= QUICK_LIMIT &&
+        (bp = cur_heap->quick[QUICK_INDEX(asize)]) != NULL) {
+        /* A deferred or pre-split block of this size is still marked allocated */
+        cur_heap->quick[QUICK_INDEX(asize)] = QUICK_NEXT(bp);
+        cur_heap->quick_bytes -= asize;
+    } else {
+        if ((bp = get_free_block(asize)) == NULL)
+            return NULL;
+        place(bp, asize);
+    }
+    MM_TRACE_EVENT(MM_EV_MALLOC, asize, MM_TRACE_NO_BIN, bp);
+    STAT_ADD(mallocs, 1);
+    STAT_ADD(live_bytes, GET_SIZE_FROM_BLK(bp));
+    STAT_ADD(requested_bytes, size);
+    STAT_ADD(allocated_bytes, GET_SIZE_FROM_BLK(bp) - BLOCK_OVERHEAD);
+    CHECK_STEP(bp);
+
+    return bp;
+}
+
+
+/**********************************************************
+ * get_adjusted_size
+ * Block size needed for a request of size bytes, including
+ * overhead and alignment reqs.
+ **********************************************************/
+size_t get_adjusted_size(size_t size)
+{
+    if (size + BLOCK_OVERHEAD <= MIN_BLOCK_SIZE)
+        return MIN_BLOCK_SIZE;
+    return DSIZE * ((size + (BLOCK_OVERHEAD) + (DSIZE-1))/ DSIZE);
+}
+
+/**********************************************************
+ * grow_step
+ * Bytes the current heap may grow beyond a request. The step
+ * doubles when extensions come close together, and is capped
+ * by a fraction of the heap
+ **********************************************************/
+size_t grow_step(void)
+{
+    heap_t *h = cur_heap;
+    size_t step;
+
+    if (h->stats.mallocs - h->grow_mark > GROW_WINDOW) {
+        h->grow_size = grow_min_size;
+    } else if (h->grow_size < grow_max_size) {
+        h->grow_size *= 2;
+    }
+    h->grow_mark = h->stats.mallocs;
+
+    step = MIN(h->grow_size, grow_max_size);
+    step = MIN(step, heap_size() >> grow_heap_shift);
+    if (h->region_end != NULL)
+        step = MIN(step, (size_t)(h->region_end - h->region_brk));
+    return step & ~(DSIZE - 1);
+}
+
+/**********************************************************
+ * get_extend_size
+ * Bytes to extend the heap by for a request of asize bytes:
+ * the missing bytes, or the growth step if larger.
+ * If the last block is free, only the missing part of asize
+ * counts, to reduce external fragmentation
+ **********************************************************/
+size_t get_extend_size(size_t asize)
+{
+    size_t needed = asize;
+
+    /* Only possible if the current heap's segment is at the top of the heap */
+    void *epilogue_bp = cur_heap->heap_end;
+    if (epilogue_bp == heap_top() && !GET_PREV_ALLOC(HDRP(epilogue_bp))) {
+        void *last_bp = PREV_BLKP(epilogue_bp);
+        needed = asize - GET_SIZE_FROM_BLK(last_bp);
+    }
+    return MAX(needed, grow_step());
+}
+
+/**********************************************************
+ * realloc_split_tail
+ * Shrink the allocated block bp to asize if the remainder is
+ * large enough to be a block of its own, and free the tail,
+ * coalescing it with the next block if that one is free
+ **********************************************************/
+void realloc_split_tail(void *bp, size_t asize)
+{
+    size_t block_size = GET_SIZE_FROM_BLK(bp);
+    size_t sub_size = block_size - asize;
+    void *sub_block;
+
+    if (block_size < asize + split_min_size) {
+        return;
+    }
+
+    MM_TRACE_EVENT(MM_EV_SPLIT, asize, MM_TRACE_NO_BIN, bp);
+    STAT_ADD(splits, 1);
+
+    PUT_ALLOC_HDR(bp, asize);
+#if !FOOTER_ELISION
+    PUT(FTRP(bp), PACK(asize, 1));
+#endif
+    sub_block = NEXT_BLKP(bp);
+    PUT(HDRP(sub_block), PACK(sub_size, 0) | PREV_ALLOC_BIT);
+    PUT_FTR(sub_block, sub_size);
+    CLR_PREV_ALLOC(NEXT_BLKP(sub_block));
+    coalesce(sub_block);
+}
+
+/**********************************************************
+ * realloc_in_place
+ * Try to resize the block in place, in this order:
+ * - shrink it and free the tail
+ * - grow into the next block if it is free
+ * - at the top of the heap, extend the heap by the missing amount
+ * - grow into the previous (and next) free block, moving the data down
+ * Return the resized block, or NULL if it has to move.
+ * Called with the lock of the block's heap held
+ *********************************************************/
+void *realloc_in_place(void *ptr, size_t size)
+{
+    void *oldptr = ptr;
+    size_t asize = get_adjusted_size(size);
+    size_t block_size = GET_SIZE_FROM_BLK(oldptr);
+    void *next = NEXT_BLKP(oldptr);
+    size_t next_size = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+    size_t copySize = block_size - BLOCK_OVERHEAD;
+
+    /* Shrink in place */
+    if (asize <= block_size) {
+        realloc_split_tail(oldptr, asize);
+        return oldptr;
+    }
+
+    /* Grow into the next free block */
+    if (block_size + next_size >= asize) {
+        remove_free_block(next);
+        CHECK_FORGET(next);
+        PUT_ALLOC_HDR(oldptr, block_size + next_size);
+#if !FOOTER_ELISION
+        PUT(FTRP(oldptr), PACK(block_size + next_size, 1));
+#endif
+        SET_PREV_ALLOC(NEXT_BLKP(oldptr));
+        trim_touch(oldptr, asize);
+        realloc_split_tail(oldptr, asize);
+        return oldptr;
+    }
+
+    /* Last block in the heap (possibly followed by a free block):
+     * extend the heap by the missing amount, or by the growth step
+     * if larger, which the block keeps as headroom */
+    void *epilogue = GET_SIZE(HDRP(next)) == 0 ? next :
+        (next_size > 0 && GET_SIZE(HDRP(NEXT_BLKP(next))) == 0) ? NEXT_BLKP(next) : NULL;
+    if (epilogue != NULL) {
+        size_t missing = asize - block_size - next_size;
+        void *bp = (void *)-1;
+        SBRK_LOCK();
+        if ((char *)epilogue == heap_top()) {
+            missing = MAX(missing, grow_step());
+            bp = heap_sbrk(missing);
+        }
+        SBRK_UNLOCK();
+        if (bp != (void *)-1) {
+            MM_TRACE_EVENT(MM_EV_EXTEND, missing, MM_TRACE_NO_BIN, bp);
+            STAT_ADD(extends, 1);
+            STAT_ADD(extend_bytes, missing);
+            if (next_size > 0) {
+                remove_free_block(next);
+            }
+            CHECK_FORGET(next);
+            CHECK_FORGET(epilogue);
+            asize = block_size + next_size + missing;
+            PUT_ALLOC_HDR(oldptr, asize);
+#if !FOOTER_ELISION
+            PUT(FTRP(oldptr), PACK(asize, 1));
+#endif
+            PUT(HDRP(NEXT_BLKP(oldptr)), PACK(0, 1) | PREV_ALLOC_BIT);   // new epilogue header
+            cur_heap->heap_end = NEXT_BLKP(oldptr);
+            trim_touch(oldptr, asize);
+            return oldptr;
+        }
+    }
+
+    /* Grow into the previous free block, and the next one if needed */
+    if (!GET_PREV_ALLOC(HDRP(oldptr))) {
+        void *prev = PREV_BLKP(oldptr);
+        size_t prev_size = GET_SIZE_FROM_BLK(prev);
+        if (prev_size + block_size + next_size >= asize) {
+            size_t new_size = prev_size + block_size;
+            remove_free_block(prev);
+            CHECK_FORGET(oldptr);
+            if (new_size < asize) {
+                remove_free_block(next);
+                CHECK_FORGET(next);
+                new_size += next_size;
+            }
+            /* The blocks overlap, so move the data with memmove */
+            memmove(prev, oldptr, copySize);
+            PUT_ALLOC_HDR(prev, new_size);
+#if !FOOTER_ELISION
+            PUT(FTRP(prev), PACK(new_size, 1));
+#endif
+            SET_PREV_ALLOC(NEXT_BLKP(prev));
+            trim_touch(prev, asize);
+            realloc_split_tail(prev, asize);
+            return prev;
+        }
+    }
+
+    return NULL;
+}
+
+/**********************************************************
+ * mm_realloc
+ * Resize the block in place if possible. Otherwise allocate
+ * a new block with some headroom, copy the data and free the
+ * old block. Blocks at or above mmap_threshold live in their
+ * own mapping and are resized with mremap.
+ *********************************************************/
+void *mm_realloc(void *ptr, size_t size)
+{
+    /* If size == 0 then this is just free, and we return NULL. */
+    if(size == 0){
+      mm_free(ptr);
+      return NULL;
+    }
+    /* If oldptr is NULL, then this is just malloc. */
+    if (ptr == NULL)
+      return (mm_malloc(size));
+
+    /* Slab objects stay put while the class still fits, otherwise move */
+    if (slab_is_run(ptr)) {
+        size_t obj_size = RUN_OF(ptr)->obj_size;
+        void *newptr;
+        if (size <= obj_size && slab_class(size) == RUN_OF(ptr)->sclass) {
+            STAT_ATOMIC_ADD(realloc_in_place_count, 1);
+            return ptr;
+        }
+        STAT_ATOMIC_ADD(realloc_move_count, 1);
+        if ((newptr = mm_malloc(size)) == NULL)
+            return NULL;
+        memcpy(newptr, ptr, size < obj_size ? size : obj_size);
+        mm_free(ptr);
+        return newptr;
+    }
+
+    int huge = mmap_threshold != 0 && size >= mmap_threshold;
+
+    /* Mapped blocks are resized by remapping while they stay huge */
+    if (IS_MMAPPED(ptr)) {
+        size_t old_size = MMAP_LEN(ptr) - ((char *)ptr - MMAP_BASE(ptr));
+        void *newptr;
+        MM_TRACE_EVENT(MM_EV_REALLOC, size, MM_TRACE_NO_BIN, ptr);
+        if (huge) {
+            STAT_ATOMIC_ADD(realloc_in_place_count, 1);
+            return mmap_realloc(ptr, size);
+        }
+        STAT_ATOMIC_ADD(realloc_move_count, 1);
+        if ((newptr = mm_malloc(size)) == NULL)
+            return NULL;
+        bulk_copy(newptr, ptr, size < old_size ? size : old_size);
+        mmap_free(ptr);
+        return newptr;
+    }
+
+    void *oldptr = ptr;
+    heap_t *h = HEAP_OF(oldptr);
+    size_t copySize = GET_SIZE_FROM_BLK(oldptr) - BLOCK_OVERHEAD;
+    void *newptr;
+
+    MM_TRACE_EVENT(MM_EV_REALLOC, size, MM_TRACE_NO_BIN, oldptr);
+
+    /* A block that grows huge moves to a mapping, where later growth is cheap */
+    if (huge) {
+        STAT_ATOMIC_ADD(realloc_move_count, 1);
+        if ((newptr = mmap_alloc(size)) == NULL)
+            return NULL;
+        bulk_copy(newptr, oldptr, copySize < size ? copySize : size);
+        mm_free(oldptr);
+        return newptr;
+    }
+
+    HEAP_ENTER(h);
+    newptr = realloc_in_place(oldptr, size);
+    if (newptr != NULL) {
+        STAT_ADD(live_bytes, GET_SIZE_FROM_BLK(newptr) - (copySize + BLOCK_OVERHEAD));
+        CHECK_STEP(newptr);
+    }
+    HEAP_LEAVE(h);
+    if (newptr != NULL) {
+      STAT_ATOMIC_ADD(realloc_in_place_count, 1);
+      return newptr;
+    }
+
+    /* Move the block, leaving headroom for further growth */
+    STAT_ATOMIC_ADD(realloc_move_count, 1);
+    newptr = mm_malloc((size_t)(size * (1 + realloc_headroom / 100.0)));
+    if (newptr == NULL)
+      return NULL;
+
+    /* Copy the old data. */
+    if (size < copySize)
+      copySize = size;
+    bulk_copy(newptr, oldptr, copySize);
+    mm_free(oldptr);
+
+    return newptr;
+}
+
+/**********************************************************
+ * calloc_zero
+ * Zero the first n bytes of the block bp just allocated for
+ * mm_calloc. With fresh set, the bytes from there on were
+ * still zero before the allocation, except the footer of the
+ * last block and the epilogue header in front of old_end.
+ * The allocation may also have written the footer of a new
+ * last free block into bp
+ **********************************************************/
+static void calloc_zero(char *bp, size_t n, char *fresh, char *old_end)
+{
+    char *end = bp + n;
+    char *dirty = (fresh == NULL || fresh > end) ? end : MAX(bp, fresh);
+    char *stale[3];
+    int i;
 
-    /* If last block is free, only extend (extendsize - free_block_size) to reduce external fragmentation*/
-    void *last_bp = PREV_BLKP(mem_heap_hi() + 1);
-    if (!GET_ALLOC(HDRP(last_bp))) {
-        extendsize = asize - GET_SIZE_FROM_BLK(last_bp);
+    bulk_zero(bp, dirty - bp);
+    if (dirty < end) {
+        stale[0] = old_end - DSIZE;
+        stale[1] = old_end - WSIZE;
+        stale[2] = FTRP(bp);
+        for (i = 0; i < 3; i ++) {
+            if (stale[i] >= dirty && stale[i] < end)
+                PUT(stale[i], 0);
+        }
     }
-    return extendsize;
 }
 
 /**********************************************************
- * mm_realloc
- * Implemented simply in terms of mm_malloc and mm_free
- *********************************************************/
-void *mm_realloc(void *ptr, size_t size)
+ * mm_calloc
+ * Allocate zeroed memory for nmemb objects of size bytes.
+ * A huge request gets a new mapping, which is zero already
+ **********************************************************/
+void *mm_calloc(size_t nmemb, size_t size)
 {
-    printf("Realloc\n");
-    fflush(stdout);
-    /* If size == 0 then this is just free, and we return NULL. */
-    if(size == 0){
-      mm_free(ptr);
-      return NULL;
+    size_t n;
+    void *bp;
+
+    if (size != 0 && nmemb > SIZE_MAX / size)
+        return NULL;
+    n = nmemb * size;
+    if (n == 0)
+        return NULL;
+    if (mmap_threshold != 0 && n >= mmap_threshold)
+        return mmap_alloc(n);
+    if ((bp = mm_malloc(n)) != NULL)
+        calloc_zero(bp, n, NULL, NULL);
+    return bp;
+}
+
+/**********************************************************
+ * mm_memalign
+ * Allocate size bytes at an address that is a multiple of
+ * align, a power of two. The block is taken from a free block
+ * that already fits at an aligned payload where possible, and
+ * the padding in front of it is freed again, so at most the
+ * rounding to a block size is lost. Returns NULL for an align
+ * that is not a power of two
+ **********************************************************/
+void *mm_memalign(size_t align, size_t size)
+{
+    size_t asize;
+    heap_t *h;
+    void *bp;
+
+    if (align == 0 || (align & (align - 1)) != 0)
+        return NULL;
+    if (align <= DSIZE)
+        return mm_malloc(size);
+    if (size == 0 || size > SIZE_MAX / 4 || align > SIZE_MAX / 4)
+        return NULL;
+    if (mmap_threshold != 0 && size >= mmap_threshold)
+        return mmap_memalign(align, size);
+
+    h = get_thread_heap();
+    HEAP_ENTER(h);
+    asize = get_adjusted_size(size);
+    if ((bp = alloc_aligned_block(align, asize)) != NULL) {
+        MM_TRACE_EVENT(MM_EV_MALLOC, asize, MM_TRACE_NO_BIN, bp);
+        STAT_ADD(mallocs, 1);
+        STAT_ADD(live_bytes, GET_SIZE_FROM_BLK(bp));
+        STAT_ADD(requested_bytes, size);
+        STAT_ADD(allocated_bytes, GET_SIZE_FROM_BLK(bp) - BLOCK_OVERHEAD);
+        CHECK_STEP(bp);
     }
-    /* If oldptr is NULL, then this is just malloc. */
-    if (ptr == NULL)
-      return (mm_malloc(size));
+    HEAP_LEAVE(h);
+    return bp;
+}
 
-    void *oldptr = ptr;
+/**********************************************************
+ * mm_malloc_batch
+ * Allocate n blocks of size bytes into out[], taking the
+ * calling thread's arena lock once. Returns the number of
+ * blocks allocated, fewer than n only if memory runs out
+ **********************************************************/
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+    size_t i = 0;
+    heap_t *h;
 
-    /* Keep copies of the first 2 words since they will be overwritten after freeing */
-    void *first_word = GET_PREV_FBLOCK(oldptr);
-    void *second_word = GET_NEXT_FBLOCK(oldptr);
-    size_t copySize = GET_SIZE(HDRP(oldptr));
+    if (size == 0)
+        return 0;
 
+#ifdef MM_THREADS
+    if (size <= SLAB_MAX_SIZE) {
+        tcache_bin_t *tc = &tcache[slab_class(size)];
+        while (i < n && tc->count > 0)
+            out[i++] = tc->slots[--tc->count];
+    }
+#endif
 
-    size_t tmp;
-    printf("Oldptr address before free = %p\n", oldptr);
-    int i;
-    for (i = 0 ; i < copySize / WSIZE - 2; i++) {
-        tmp = GET(((char*)oldptr)+i*WSIZE);
-        printf("%zu, ", tmp);
+    if (mmap_threshold != 0 && size >= mmap_threshold) {
+        for (; i < n; i ++) {
+            if ((out[i] = mmap_alloc(size)) == NULL)
+                break;
+        }
+        return i;
     }
-    printf("\n");
 
-    mm_free(oldptr);
+    h = get_thread_heap();
+    HEAP_ENTER(h);
+    i += heap_malloc_batch(size, n - i, out + i);
+    HEAP_LEAVE(h);
+    return i;
+}
 
+/**********************************************************
+ * heap_malloc_batch
+ * Allocate n blocks of size bytes in the current heap.
+ * Slab sizes are served one by one, a run hands them out
+ * cheaply already. General blocks are first popped from the
+ * quick list of their size, the rest are carved side by side
+ * out of one free block (or extension) of up to BATCH_MAX_SIZE
+ * bytes per pass, with one search and one split for all of
+ * them. The last block of a pass keeps a surplus too small
+ * to split off
+ **********************************************************/
+size_t heap_malloc_batch(size_t size, size_t n, void **out)
+{
+    size_t asize, bsize, k, j, i = 0, bytes = 0;
+    char *bp, *p;
 
+    if (size <= SLAB_MAX_SIZE && cur_heap->region_end == NULL) {
+        for (; i < n; i ++) {
+            if ((out[i] = heap_malloc(size)) == NULL)
+                break;
+        }
+        return i;
+    }
 
-    split_flag = 0;
-    void *newptr = mm_malloc((size_t)(size * 1.5));
-    split_flag = 1;
+    asize = get_adjusted_size(size);
+    if (QUICK_LIMIT && asize <= QUICK_LIMIT) {
+        void **quick = &cur_heap->quick[QUICK_INDEX(asize)];
+        while (i < n && *quick != NULL) {
+            bp = *quick;
+            *quick = QUICK_NEXT(bp);
+            cur_heap->quick_bytes -= asize;
+            MM_TRACE_EVENT(MM_EV_MALLOC, asize, MM_TRACE_NO_BIN, bp);
+            bytes += asize;
+            out[i++] = bp;
+        }
+    }
 
-    printf("Oldptr address after malloc = %p\n", oldptr);
-    for (i = 0 ; i < copySize / WSIZE - 2; i++) {
-        tmp = GET(((char*)oldptr)+i*WSIZE);
-        printf("%zu, ", tmp);
+    while (i < n) {
+        k = MIN(n - i, MAX(BATCH_MAX_SIZE / asize, 1));
+        if ((bp = get_free_block(k * asize)) == NULL)
+            break;
+        bsize = GET_SIZE_FROM_BLK(bp);
+        trim_touch(bp, bsize);
+        for (j = 0, p = bp; j < k; j ++, p += asize) {
+            size_t psize = j + 1 < k ? asize : bsize - j * asize;
+            if (j > 0)
+                PUT(HDRP(p), PREV_ALLOC_BIT);
+            PUT_ALLOC_HDR(p, psize);
+#if !FOOTER_ELISION
+            PUT(FTRP(p), PACK(psize, 1));
+#endif
+            MM_TRACE_EVENT(MM_EV_MALLOC, asize, MM_TRACE_NO_BIN, p);
+            out[i++] = p;
+        }
+        SET_PREV_ALLOC(bp + bsize);
+        bytes += bsize;
+        CHECK_STEP(bp);
     }
-    printf("\n");
 
+    STAT_ADD(mallocs, i);
+    STAT_ADD(live_bytes, bytes);
+    STAT_ADD(requested_bytes, i * size);
+    STAT_ADD(allocated_bytes, bytes - i * BLOCK_OVERHEAD);
+    return i;
+}
 
-    if (newptr == NULL)
-      return NULL;
+/**********************************************************
+ * free_batch_list
+ * Free a list of general blocks of the current heap, sorted
+ * by address. Each run of adjacent blocks is merged into one
+ * block first, which is then coalesced and put on a free list
+ * once for the whole run
+ **********************************************************/
+static void free_batch_list(void *list)
+{
+    char *bp, *next;
+    size_t size, count;
+
+    while (list != NULL) {
+        bp = list;
+        size = GET_SIZE_FROM_BLK(bp);
+        count = 1;
+        for (next = QUICK_NEXT(bp); next == bp + size; next = QUICK_NEXT(next)) {
+            MM_TRACE_EVENT(MM_EV_FREE, GET_SIZE_FROM_BLK(next), MM_TRACE_NO_BIN, next);
+            CHECK_FORGET(next);
+            size += GET_SIZE_FROM_BLK(next);
+            count ++;
+        }
+        STAT_ADD(frees, count);
+        STAT_ADD(live_bytes, -size);
+        PUT_HDR(bp, size, 1);
+        free_block(bp);
+        list = next;
+    }
+}
 
-    /* Copy the old data. */
-    if (size < copySize)
-      copySize = size;
-    memcpy(newptr, oldptr, copySize);
-    PUT_PREV_FBLOCK(newptr, first_word);
-    PUT_NEXT_FBLOCK(newptr, second_word);
-    
+/**********************************************************
+ * mm_free_batch
+ * mm_free the n blocks of ptrs[], skipping NULLs. General
+ * blocks are linked through their payloads into one list per
+ * arena, sorted by address and freed a run of neighbours at a
+ * time, with each arena's lock taken once. They are not
+ * deferred on the quick lists
+ **********************************************************/
+void mm_free_batch(void **ptrs, size_t n)
+{
+    void *lists[ARENA_COUNT] = { NULL };
+    size_t i;
+    unsigned a;
+
+    for (i = 0; i < n; i ++) {
+        void *bp = ptrs[i];
+        if (bp == NULL)
+            continue;
+        if (slab_is_run(bp) || IS_MMAPPED(bp)) {
+            mm_free(bp);
+            continue;
+        }
+        a = HEAP_OF(bp) - arenas;
+        PUT_QUICK_NEXT(bp, lists[a]);
+        lists[a] = bp;
+    }
+    for (a = 0; a < ARENA_COUNT; a ++) {
+        if (lists[a] == NULL)
+            continue;
+        HEAP_ENTER(&arenas[a]);
+        free_batch_list(quick_sort(lists[a]));
+        HEAP_LEAVE(&arenas[a]);
+    }
+}
+
+/**********************************************************
+ * mm_heap_create
+ * Create a heap of its own with up to size bytes (0 for
+ * MM_HEAP_DEFAULT_SIZE). Its state and blocks live in one
+ * anonymous mapping, whose pages are only touched as the heap
+ * grows. Returns NULL if the mapping fails
+ **********************************************************/
+mm_heap_t *mm_heap_create(size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t hsize = (sizeof(heap_t) + DSIZE - 1) & ~(DSIZE - 1);
+    size_t len;
+    char *base, *heap_listp;
+    heap_t *h;
+
+    if (size == 0)
+        size = MM_HEAP_DEFAULT_SIZE;
+    len = (hsize + 4 * WSIZE + size + page - 1) & ~(page - 1);
+    base = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    h = (heap_t *)base;
+    heap_init(h, 0);
+
+    /* Same prologue and epilogue as mm_init */
+    heap_listp = base + hsize;
+    PUT(heap_listp, 0);                         // alignment padding
+    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1) | PREV_ALLOC_BIT);   // prologue header
+    PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1));   // prologue footer
+    PUT(heap_listp + (3 * WSIZE), PACK(0, 1) | PREV_ALLOC_BIT);    // epilogue header
+    h->heap_end = heap_listp + 4 * WSIZE;
+    h->region_brk = h->heap_end;
+    h->region_end = base + len;
+    h->fresh = h->heap_end;
+    return h;
+}
+
+/**********************************************************
+ * mm_heap_destroy
+ * Release heap h and every block in it at once
+ **********************************************************/
+void mm_heap_destroy(mm_heap_t *h)
+{
+    if (h == NULL)
+        return;
+    if (cur_heap == h)
+        cur_heap = &arenas[0];
+#ifdef MM_THREADS
+    pthread_mutex_destroy(&h->lock);
+#endif
+    munmap(h, h->region_end - (char *)h);
+}
+
+/**********************************************************
+ * mm_heap_malloc
+ * mm_malloc from heap h, or from the default heap if h is
+ * NULL. Returns NULL when h is full
+ **********************************************************/
+void *mm_heap_malloc(mm_heap_t *h, size_t size)
+{
+    void *bp;
+
+    if (h == NULL)
+        return mm_malloc(size);
+    if (size == 0)
+        return NULL;
+    HEAP_ENTER(h);
+    bp = heap_malloc(size);
+    HEAP_LEAVE(h);
+    return bp;
+}
+
+/**********************************************************
+ * mm_heap_calloc
+ * mm_calloc from heap h. Memory the heap has just obtained
+ * from its mapping is not zeroed again
+ **********************************************************/
+void *mm_heap_calloc(mm_heap_t *h, size_t nmemb, size_t size)
+{
+    size_t n;
+    char *bp, *fresh, *old_end;
+
+    if (h == NULL)
+        return mm_calloc(nmemb, size);
+    if (size != 0 && nmemb > SIZE_MAX / size)
+        return NULL;
+    n = nmemb * size;
+    if (n == 0)
+        return NULL;
+    HEAP_ENTER(h);
+    fresh = h->fresh;
+    old_end = h->heap_end;
+    bp = heap_malloc(n);
+    HEAP_LEAVE(h);
+    if (bp != NULL)
+        calloc_zero(bp, n, fresh, old_end);
+    return bp;
+}
+
+/**********************************************************
+ * mm_heap_free
+ * mm_free a block of heap h
+ **********************************************************/
+void mm_heap_free(mm_heap_t *h, void *ptr)
+{
+    if (h == NULL) {
+        mm_free(ptr);
+        return;
+    }
+    if (ptr == NULL)
+        return;
+    HEAP_ENTER(h);
+    heap_free(ptr);
+    HEAP_LEAVE(h);
+}
+
+/**********************************************************
+ * mm_heap_free_sized
+ * mm_free_sized for a block of heap h
+ **********************************************************/
+void mm_heap_free_sized(mm_heap_t *h, void *ptr, size_t size)
+{
+    if (h == NULL) {
+        mm_free_sized(ptr, size);
+        return;
+    }
+    if (ptr == NULL)
+        return;
+    PREFETCH_W(HDRP(ptr) + get_adjusted_size(size));
+    HEAP_ENTER(h);
+    heap_free(ptr);
+    HEAP_LEAVE(h);
+}
+
+/**********************************************************
+ * mm_heap_realloc
+ * mm_realloc a block of heap h, which stays in h
+ **********************************************************/
+void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size)
+{
+    size_t copySize;
+    void *newptr;
+
+    if (h == NULL)
+        return mm_realloc(ptr, size);
+    if (size == 0) {
+        mm_heap_free(h, ptr);
+        return NULL;
+    }
+    if (ptr == NULL)
+        return mm_heap_malloc(h, size);
+
+    HEAP_ENTER(h);
+    copySize = GET_SIZE_FROM_BLK(ptr) - BLOCK_OVERHEAD;
+    MM_TRACE_EVENT(MM_EV_REALLOC, size, MM_TRACE_NO_BIN, ptr);
+    newptr = realloc_in_place(ptr, size);
+    if (newptr != NULL) {
+        STAT_ADD(live_bytes, GET_SIZE_FROM_BLK(newptr) - (copySize + BLOCK_OVERHEAD));
+        CHECK_STEP(newptr);
+    } else if ((newptr = heap_malloc(size)) != NULL) {
+        bulk_copy(newptr, ptr, MIN(size, copySize));
+        heap_free(ptr);
+    }
+    HEAP_LEAVE(h);
     return newptr;
 }
 
+/**********************************************************
+ * mm_arena_begin
+ * Start an arena that bump allocates from chunks of
+ * chunk_size bytes (0 for MM_ARENA_CHUNK). The first chunk is
+ * taken on the first allocation
+ **********************************************************/
+mm_arena_t *mm_arena_begin(size_t chunk_size)
+{
+    mm_arena_t *a = mm_malloc(sizeof(mm_arena_t));
+
+    if (a == NULL)
+        return NULL;
+    if (chunk_size == 0)
+        chunk_size = MM_ARENA_CHUNK;
+    a->chunk_size = MAX(chunk_size, 4 * ARENA_LINK) & ~(DSIZE - 1);
+    a->cur = NULL;
+    a->end = NULL;
+    a->chunks = NULL;
+    a->large = NULL;
+    return a;
+}
+
+/**********************************************************
+ * arena_refill
+ * Slow path of mm_arena_alloc: a large object gets a general
+ * block of its own, otherwise a new chunk is started. The
+ * rest of the old chunk is wasted until the reset
+ **********************************************************/
+static void *arena_refill(mm_arena_t *a, size_t size)
+{
+    char *bp;
+
+    if (size > a->chunk_size / 4) {
+        if ((bp = mm_malloc(size + ARENA_LINK)) == NULL)
+            return NULL;
+        PUT(bp, (uintptr_t)a->large);
+        a->large = bp;
+        return bp + ARENA_LINK;
+    }
+
+    if ((bp = mm_malloc(a->chunk_size)) == NULL)
+        return NULL;
+    PUT(bp, (uintptr_t)a->chunks);
+    a->chunks = bp;
+    a->cur = bp + ARENA_LINK + size;
+    a->end = bp + a->chunk_size;
+    return bp + ARENA_LINK;
+}
+
+/**********************************************************
+ * mm_arena_alloc
+ * Allocate size bytes from arena a by bumping a pointer. The
+ * object has no header and cannot be freed on its own
+ **********************************************************/
+void *mm_arena_alloc(mm_arena_t *a, size_t size)
+{
+    char *bp = a->cur;
+
+    if (size == 0)
+        return NULL;
+    size = (size + DSIZE - 1) & ~(DSIZE - 1);
+    if (size <= (size_t)(a->end - bp)) {
+        a->cur = bp + size;
+        return bp;
+    }
+    return arena_refill(a, size);
+}
+
+/**********************************************************
+ * arena_release
+ * Free the large objects of arena a, and its chunks after
+ * the first keep ones
+ **********************************************************/
+static void arena_release(mm_arena_t *a, int keep)
+{
+    void *bp, *next;
+
+    for (bp = a->large; bp != NULL; bp = next) {
+        next = (void *)GET(bp);
+        mm_free(bp);
+    }
+    a->large = NULL;
+
+    bp = a->chunks;
+    if (keep && bp != NULL) {
+        next = (void *)GET(bp);
+        PUT(bp, 0);
+        a->cur = (char *)bp + ARENA_LINK;
+        bp = next;
+    } else {
+        a->chunks = NULL;
+        a->cur = NULL;
+        a->end = NULL;
+    }
+    for (; bp != NULL; bp = next) {
+        next = (void *)GET(bp);
+        mm_free(bp);
+    }
+}
+
+/**********************************************************
+ * mm_arena_reset
+ * Release every object of arena a at once. The current chunk
+ * is kept for the next round of allocations
+ **********************************************************/
+void mm_arena_reset(mm_arena_t *a)
+{
+    arena_release(a, 1);
+}
+
+/**********************************************************
+ * mm_arena_end
+ * Release every object of arena a and the arena itself
+ **********************************************************/
+void mm_arena_end(mm_arena_t *a)
+{
+    if (a == NULL)
+        return;
+    arena_release(a, 0);
+    mm_free(a);
+}
+
+#define CHECK_FAIL(...) \
+    do { fprintf(stderr, "mm_check: " __VA_ARGS__); fprintf(stderr, "\n"); ok = 0; } while (0)
+
+/**********************************************************
+ * check_block
+ * Verify one block of the implicit list against itself and
+ * its next block: alignment, size, footer, the next block's
+ * prev-allocated bit and that two free blocks never touch.
+ * Slab runs also get their counters checked.
+ * Return nonzero if the block is consistent
+ *********************************************************/
+static int check_block(void *bp)
+{
+    int ok = 1;
+    size_t size = GET_SIZE_FROM_BLK(bp);
+    size_t alloc = GET_ALLOC(HDRP(bp));
+    void *next;
+
+    if ((uintptr_t)bp % DSIZE != 0)
+        CHECK_FAIL("block %p is not aligned", bp);
+    if (size == 0) {
+        if (!alloc)
+            CHECK_FAIL("epilogue %p is not allocated", bp);
+        return ok;
+    }
+    if (size < MIN_BLOCK_SIZE && bp != (char *)mem_heap_lo() + DSIZE)
+        CHECK_FAIL("block %p is smaller than the minimum (%zu)", bp, size);
+    /* Blocks outside memlib belong to the current, created heap */
+    char *top = (char *)mem_heap_hi() + 1;
+    if ((char *)bp < (char *)mem_heap_lo() || (char *)bp >= top)
+        top = cur_heap->region_brk;
+    if ((char *)bp + size > top) {
+        CHECK_FAIL("block %p of size %zu runs past the heap", bp, size);
+        return ok;
+    }
+    if (!alloc && GET(FTRP(bp)) != PACK(size, 0))
+        CHECK_FAIL("free block %p: header size %zu, footer %#lx", bp, size,
+                   (unsigned long)GET(FTRP(bp)));
+#if !FOOTER_ELISION
+    if (alloc && GET(FTRP(bp)) != PACK(size, 1))
+        CHECK_FAIL("allocated block %p: header size %zu, footer %#lx", bp, size,
+                   (unsigned long)GET(FTRP(bp)));
+#endif
+
+    next = NEXT_BLKP(bp);
+    if (!GET_PREV_ALLOC(HDRP(next)) != !alloc)
+        CHECK_FAIL("block %p: prev-allocated bit of the next block is %s",
+                   bp, alloc ? "clear" : "set");
+    if (coalesce_flag && !alloc && !GET_ALLOC(HDRP(next)))
+        CHECK_FAIL("free blocks %p and %p were not coalesced", bp, next);
+
+    if (alloc && slab_is_run(bp)) {
+        slab_run_t *run = bp;
+        unsigned i, nfree = 0;
+        for (i = 0; i < RUN_MAP_WORDS; i ++)
+            nfree += __builtin_popcountll(run->free_map[i]);
+        if (run->obj_size != slab_class_size(run->sclass) || run->nfree > run->nobjs)
+            CHECK_FAIL("slab run %p has a bad header", bp);
+#ifndef MM_THREADS
+        /* Objects in thread caches are free in the map but counted as used */
+        if (nfree != run->nfree)
+            CHECK_FAIL("slab run %p: %u free slots in the map, nfree %u", bp, nfree, run->nfree);
+#endif
+    }
+    return ok;
+}
+
+/**********************************************************
+ * check_tree
+ * Verify the subtree at bp: free blocks big enough for the
+ * tree, in order, parent links, no red node with a red child
+ * and the same number of black nodes on every path.
+ * Return the black height, or -1 if the subtree is broken
+ *********************************************************/
+static int check_tree(void *bp, void *parent, size_t *count, size_t *bytes)
+{
+    int ok = 1;
+    int left, right;
+
+    if (bp == NULL)
+        return 1;
+    if (TREE_PARENT(bp) != parent)
+        CHECK_FAIL("tree node %p: wrong parent link", bp);
+    if (GET_ALLOC(HDRP(bp)) || GET_SIZE_FROM_BLK(bp) < TREE_MIN_SIZE)
+        CHECK_FAIL("tree node %p is allocated or too small (%zu)", bp, GET_SIZE_FROM_BLK(bp));
+    if (TREE_IS_RED(bp) && (TREE_IS_RED(TREE_LEFT(bp)) || TREE_IS_RED(TREE_RIGHT(bp))))
+        CHECK_FAIL("red tree node %p has a red child", bp);
+    if ((TREE_LEFT(bp) && !tree_less(TREE_LEFT(bp), bp)) ||
+        (TREE_RIGHT(bp) && !tree_less(bp, TREE_RIGHT(bp))))
+        CHECK_FAIL("tree node %p is out of order", bp);
+    if (!ok)
+        return -1;
+
+    (*count) ++;
+    *bytes += GET_SIZE_FROM_BLK(bp);
+    left = check_tree(TREE_LEFT(bp), bp, count, bytes);
+    right = check_tree(TREE_RIGHT(bp), bp, count, bytes);
+    if (left < 0 || right < 0)
+        return -1;
+    if (left != right) {
+        CHECK_FAIL("tree node %p: black heights %d and %d", bp, left, right);
+        return -1;
+    }
+    return left + !TREE_IS_RED(bp);
+}
+
+/**********************************************************
+ * check_free_structures
+ * Verify the bins, their bitmaps, the tree and the partial
+ * slab run lists of heap h, adding up its free blocks
+ *********************************************************/
+static int check_free_structures(heap_t *h, size_t *count, size_t *bytes)
+{
+    int ok = 1;
+    size_t limit = mem_heapsize() / MIN_BLOCK_SIZE;
+    size_t index, n;
+    void *bp, *prev;
+
+    for (index = 0; index < FREE_LIST_SIZE; index ++) {
+        size_t fl = index / SL_INDEX_COUNT, sl = index % SL_INDEX_COUNT;
+        int marked = (h->sl_bitmap[fl] >> sl) & 1;
+        if (marked != (h->flist[index] != NULL))
+            CHECK_FAIL("heap %u bin %zu: occupancy bit %d but list %s", h->id, index,
+                       marked, h->flist[index] ? "non-empty" : "empty");
+        prev = NULL;
+        n = 0;
+        for (bp = h->flist[index]; bp != NULL; bp = GET_NEXT_FBLOCK(bp)) {
+            size_t size = GET_SIZE_FROM_BLK(bp);
+            if (++n > limit) {
+                CHECK_FAIL("heap %u bin %zu has a cycle", h->id, index);
+                break;
+            }
+            if ((char *)bp < (char *)mem_heap_lo() || (char *)bp > (char *)mem_heap_hi()) {
+                CHECK_FAIL("heap %u bin %zu: block %p outside the heap", h->id, index, bp);
+                break;
+            }
+            if (GET_ALLOC(HDRP(bp)))
+                CHECK_FAIL("heap %u bin %zu: block %p is allocated", h->id, index, bp);
+            if (size >= TREE_MIN_SIZE || get_flist_index(size) != index)
+                CHECK_FAIL("heap %u bin %zu: block %p of size %zu is in the wrong bin",
+                           h->id, index, bp, size);
+            if (GET_PREV_FBLOCK(bp) != prev)
+                CHECK_FAIL("heap %u bin %zu: block %p has a bad prev link", h->id, index, bp);
+            (*count) ++;
+            *bytes += size;
+            prev = bp;
+        }
+    }
+    for (index = 0; index < FL_INDEX_COUNT; index ++) {
+        if (((h->fl_bitmap >> index) & 1) != (h->sl_bitmap[index] != 0))
+            CHECK_FAIL("heap %u first level %zu: bitmap out of sync", h->id, index);
+    }
+
+    if (h->ftree != NULL && TREE_IS_RED(h->ftree))
+        CHECK_FAIL("heap %u: tree root is red", h->id);
+    if (check_tree(h->ftree, NULL, count, bytes) < 0)
+        ok = 0;
+
+    for (index = 0; index < SLAB_CLASS_COUNT; index ++) {
+        slab_run_t *run;
+        for (run = h->slab_partial[index]; run != NULL; run = run->next) {
+            if (run->heap != h || run->sclass != index || run->nfree == 0 || !slab_is_run(run)) {
+                CHECK_FAIL("heap %u: bad run %p in partial list %zu", h->id, run, index);
+                break;
+            }
+        }
+    }
+    return ok;
+}
+
 /**********************************************************
  * mm_check
- * Check the consistency of the memory heap
+ * Check the consistency of the memory heap: walk every block
+ * of every segment from the prologue to the last epilogue,
+ * then every free structure, and make sure both agree on the
+ * number and total size of the free blocks.
+ * Prints what is wrong to stderr. In concurrent mode, call it
+ * while no other thread is in the allocator.
  * Return nonzero if the heap is consistant.
  *********************************************************/
 int mm_check(void)
 {
-  return 1;
+    int ok = 1;
+    char *brk = (char *)mem_heap_hi() + 1;
+    char *prologue = (char *)mem_heap_lo() + DSIZE;
+    char *bp;
+    size_t walk_count = 0, walk_bytes = 0;
+    size_t list_count = 0, list_bytes = 0;
+    int walked = 1;
+    unsigned a;
+
+    if (GET(HDRP(prologue)) != (PACK(DSIZE, 1) | PREV_ALLOC_BIT) ||
+        GET(FTRP(prologue)) != PACK(DSIZE, 1))
+        CHECK_FAIL("bad prologue");
+
+    bp = NEXT_BLKP(prologue);
+    while (bp < brk) {
+        if (!check_block(bp)) {
+            ok = walked = 0;
+            break;
+        }
+        if (GET_SIZE_FROM_BLK(bp) == 0) {
+            /* Epilogue below the break, another segment follows past its padding */
+            bp += DSIZE;
+            if (!GET_PREV_ALLOC(HDRP(bp)))
+                CHECK_FAIL("segment at %p: first block has its prev-allocated bit clear", bp);
+            continue;
+        }
+        if (!GET_ALLOC(HDRP(bp))) {
+            walk_count ++;
+            walk_bytes += GET_SIZE_FROM_BLK(bp);
+        }
+        bp = NEXT_BLKP(bp);
+    }
+    if (ok && (bp != brk || !check_block(bp)))
+        CHECK_FAIL("last epilogue at %p, the break is at %p", bp, brk);
+
+    for (a = 0; a < ARENA_COUNT; a ++) {
+        heap_t *h = &arenas[a];
+        if (h->heap_end != NULL && (GET(HDRP(h->heap_end)) & ~(uintptr_t)PREV_ALLOC_BIT) != PACK(0, 1))
+            CHECK_FAIL("heap %u: heap_end %p is not an epilogue", a, h->heap_end);
+        if (!check_free_structures(h, &list_count, &list_bytes))
+            ok = 0;
+    }
+    if (walked && (walk_count != list_count || walk_bytes != list_bytes))
+        CHECK_FAIL("heap walk found %zu free blocks (%zu bytes), free lists hold %zu (%zu bytes)",
+                   walk_count, walk_bytes, list_count, list_bytes);
+    return ok;
+}
+
+/**********************************************************
+ * check_step
+ * Incremental check after an operation on the general block
+ * bp: verify bp, its neighbours and the next MM_CHECK_SLICE
+ * blocks of the cycling heap walk. Aborts on corruption
+ **********************************************************/
+void check_step(void *bp)
+{
+#if MM_CHECK_SLICE
+    int ok = 1;
+
+    if (!GET_PREV_ALLOC(HDRP(bp)))
+        ok &= check_block(PREV_BLKP(bp));
+    ok &= check_block(bp);
+    ok &= check_block(NEXT_BLKP(bp));
+
+#ifndef MM_THREADS
+    char *brk = (char *)mem_heap_hi() + 1;
+    int n;
+    for (n = 0; ok && cur_heap->region_end == NULL && n < MM_CHECK_SLICE; n ++) {
+        if (check_cursor == NULL || check_cursor >= brk)
+            check_cursor = NEXT_BLKP((char *)mem_heap_lo() + DSIZE);
+        ok &= check_block(check_cursor);
+        if (GET_SIZE_FROM_BLK(check_cursor) == 0)
+            check_cursor += DSIZE;      /* epilogue of an inner segment */
+        else
+            check_cursor = NEXT_BLKP(check_cursor);
+        if (check_cursor == brk)
+            check_cursor = NULL;
+    }
+#endif
+    if (!ok) {
+        fprintf(stderr, "mm_check: heap corrupted near %p\n", bp);
+        abort();
+    }
+#else
+    (void)bp;
+#endif
+}
+
+/**********************************************************
+ * largest_free_block
+ * Size of the largest free block of the current heap: the
+ * rightmost tree node, or else the biggest block of the
+ * highest non-empty bin
+ *********************************************************/
+static size_t largest_free_block(void)
+{
+    void *bp = cur_heap->ftree;
+    size_t largest = 0;
+    int index;
+
+    if (bp != NULL) {
+        while (TREE_RIGHT(bp) != NULL)
+            bp = TREE_RIGHT(bp);
+        return GET_SIZE_FROM_BLK(bp);
+    }
+    for (index = FREE_LIST_SIZE - 1; index >= 0; index --) {
+        for (bp = cur_heap->flist[index]; bp != NULL; bp = GET_NEXT_FBLOCK(bp))
+            largest = MAX(largest, GET_SIZE_FROM_BLK(bp));
+        if (largest > 0)
+            break;
+    }
+    return largest;
+}
+
+/**********************************************************
+ * mm_stats
+ * Add up the counters of every heap. Apart from finding the
+ * largest free block this only reads counters kept up to
+ * date on the allocation paths
+ *********************************************************/
+void mm_stats(mm_stats_t *st)
+{
+    unsigned a, i;
+
+    memset(st, 0, sizeof(*st));
+    for (a = 0; a < ARENA_COUNT; a ++) {
+        heap_t *h = &arenas[a];
+        HEAP_ENTER(h);
+        st->live_bytes += h->stats.live_bytes;
+        for (i = 0; i < FREE_LIST_SIZE; i ++) {
+            st->bin_free_bytes[i] += h->stats.bin_bytes[i];
+            st->free_bytes += h->stats.bin_bytes[i];
+        }
+        st->largest_free = MAX(st->largest_free, largest_free_block());
+        st->mallocs += h->stats.mallocs;
+        st->frees += h->stats.frees;
+        st->splits += h->stats.splits;
+        for (i = 0; i < 4; i ++)
+            st->coalesces[i] += h->stats.coalesces[i];
+        st->extends += h->stats.extends;
+        st->extend_bytes += h->stats.extend_bytes;
+        st->requested_bytes += h->stats.requested_bytes;
+        st->allocated_bytes += h->stats.allocated_bytes;
+        st->deferred_bytes += h->quick_bytes;
+        HEAP_LEAVE(h);
+    }
+    st->heap_size = mem_heapsize();
+    st->mmap_bytes = __atomic_load_n(&mmap_bytes, __ATOMIC_RELAXED);
+    st->mmap_blocks = __atomic_load_n(&mmap_blocks, __ATOMIC_RELAXED);
+    st->realloc_in_place = __atomic_load_n(&realloc_in_place_count, __ATOMIC_RELAXED);
+    st->realloc_moves = __atomic_load_n(&realloc_move_count, __ATOMIC_RELAXED);
+    if (st->allocated_bytes > 0)
+        st->internal_frag = 1.0 - (double)st->requested_bytes / st->allocated_bytes;
+}
+
+/**********************************************************
+ * mm_dump_histogram
+ * Walk the heap and print how many blocks, and bytes, of each
+ * power of two size range are allocated and free, then the
+ * live objects of each slab class. Like mm_check, call it
+ * while no other thread is in the allocator
+ *********************************************************/
+void mm_dump_histogram(void)
+{
+    enum { RANGES = 8 * sizeof(size_t) };
+    unsigned long alloc_n[RANGES] = { 0 }, free_n[RANGES] = { 0 };
+    size_t alloc_b[RANGES] = { 0 }, free_b[RANGES] = { 0 };
+    unsigned long objs[SLAB_CLASS_COUNT] = { 0 }, runs[SLAB_CLASS_COUNT] = { 0 };
+    char *brk = (char *)mem_heap_hi() + 1;
+    char *bp = NEXT_BLKP((char *)mem_heap_lo() + DSIZE);
+    unsigned i;
+
+    while (bp < brk) {
+        size_t size = GET_SIZE_FROM_BLK(bp);
+        if (size == 0) {
+            bp += DSIZE;        /* epilogue of an inner segment */
+            continue;
+        }
+        i = sizeof(unsigned long) * 8 - 1 - __builtin_clzl(size);
+        if (!GET_ALLOC(HDRP(bp))) {
+            free_n[i] ++;
+            free_b[i] += size;
+        } else if (slab_is_run(bp)) {
+            slab_run_t *run = (slab_run_t *)bp;
+            runs[run->sclass] ++;
+            objs[run->sclass] += run->nobjs - run->nfree;
+        } else {
+            alloc_n[i] ++;
+            alloc_b[i] += size;
+        }
+        bp = NEXT_BLKP(bp);
+    }
+
+    printf("%-21s %10s %12s %10s %12s\n", "block size", "allocated", "bytes", "free", "bytes");
+    for (i = 0; i < RANGES; i ++) {
+        if (alloc_n[i] == 0 && free_n[i] == 0)
+            continue;
+        printf("%9zu - %9zu %10lu %12zu %10lu %12zu\n", (size_t)1 << i, ((size_t)2 << i) - 1,
+               alloc_n[i], alloc_b[i], free_n[i], free_b[i]);
+    }
+    printf("%-21s %10s %12s\n", "slab object size", "runs", "live objects");
+    for (i = 0; i < SLAB_CLASS_COUNT; i ++) {
+        if (runs[i] == 0)
+            continue;
+        printf("%21zu %10lu %12lu\n", slab_class_size(i), runs[i], objs[i]);
+    }
+    printf("mapped huge blocks: %lu, %zu bytes\n",
+           __atomic_load_n(&mmap_blocks, __ATOMIC_RELAXED),
+           __atomic_load_n(&mmap_bytes, __ATOMIC_RELAXED));
+    fflush(stdout);
+}
+
+/**********************************************************
+ * print_ftree
+ * Debug helper that prints the sizes in the free block tree
+ * in order
+ *********************************************************/
+void print_ftree(void *bp)
+{
+    if (bp == NULL) {
+        return;
+    }
+    print_ftree(TREE_LEFT(bp));
+    printf("%zu%s, ", GET_SIZE_FROM_BLK(bp) / WSIZE, TREE_IS_RED(bp) ? "r" : "");
+    print_ftree(TREE_RIGHT(bp));
 }
 
+/**********************************************************
+ * print_flist
+ * Debug helper that prints every bin of the free list.
+ * Walks the whole list, so never call it on the hot path
+ *********************************************************/
 void print_flist(void)
 {
     int i;
@@ -611,7 +3856,7 @@ void print_flist(void)
     printf("Full Free List:\n");
     for (i = 0; i < FREE_LIST_SIZE; i++) {
         printf("%i -> ", i);
-        bp = flist[i];
+        bp = cur_heap->flist[i];
         while (bp != NULL) {
             size = GET_SIZE_FROM_BLK(bp);
             printf("%zu, ", size / WSIZE);
@@ -619,5 +3864,8 @@ void print_flist(void)
         }
         printf("\n");
     }
+    printf("tree -> ");
+    print_ftree(cur_heap->ftree);
+    printf("\n");
     fflush(stdout);
 }
\ No newline at end of file
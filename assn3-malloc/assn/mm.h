@@ -6,7 +6,107 @@
 int mm_init(void);
 void *mm_malloc(size_t size);
 void mm_free(void *ptr);
+/* mm_free when the caller knows the size last asked for the block, which
+ * saves lookups on the free path. A different size is undefined */
+void mm_free_sized(void *ptr, size_t size);
+/* Bytes usable in the block at ptr, at least the size asked for it */
+size_t mm_usable_size(void *ptr);
 void *mm_realloc(void *ptr, size_t size);
+void *mm_calloc(size_t nmemb, size_t size);
+
+/* Allocate n blocks of size bytes into out[] at once; returns how many were
+ * allocated, fewer than n only when memory runs out. mm_free_batch frees n
+ * blocks (NULLs allowed), coalescing neighbours among them in one go */
+size_t mm_malloc_batch(size_t size, size_t n, void **out);
+void mm_free_batch(void **ptrs, size_t n);
+
+/* Allocate size bytes aligned to align, a power of two; NULL if it is not.
+ * The block is freed and resized with mm_free and mm_realloc, though a
+ * resize may move it to an address with only the default alignment */
+void *mm_memalign(size_t align, size_t size);
+
+/* Heaps of their own: each has its own free lists and backing mapping, so
+ * one component's fragmentation does not reach the others, and
+ * mm_heap_destroy releases all of its blocks at once. size is the most
+ * the heap can grow to, 0 for a default. Passing a NULL heap to the
+ * functions below uses the default heap of mm_malloc. Blocks must be freed
+ * and resized through the heap they came from */
+typedef struct mm_heap mm_heap_t;
+
+mm_heap_t *mm_heap_create(size_t size);
+void mm_heap_destroy(mm_heap_t *h);
+void *mm_heap_malloc(mm_heap_t *h, size_t size);
+void *mm_heap_calloc(mm_heap_t *h, size_t nmemb, size_t size);
+void mm_heap_free(mm_heap_t *h, void *ptr);
+void mm_heap_free_sized(mm_heap_t *h, void *ptr, size_t size);
+void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size);
+
+/* Bump allocation arenas for objects that die together: mm_arena_alloc
+ * carves headerless objects out of chunks of the general heap (chunk_size
+ * bytes each, 0 for a default), and objects too big for a chunk fall back
+ * to general blocks. Objects are never freed one by one; mm_arena_reset
+ * releases all of them at once and mm_arena_end also the arena. An arena
+ * must not be used by two threads at the same time */
+typedef struct mm_arena mm_arena_t;
+
+mm_arena_t *mm_arena_begin(size_t chunk_size);
+void *mm_arena_alloc(mm_arena_t *a, size_t size);
+void mm_arena_reset(mm_arena_t *a);
+void mm_arena_end(mm_arena_t *a);
+
+/* Release the unused pages of free memory, keeping pad bytes at the top
+ * of the heap. Returns 1 if any memory was released */
+int mm_trim(size_t pad);
+
+/* Tuning parameters of the general heap, read and replaced as a set;
+ * mm_tune searches them on traces. mm_set_params returns -1 and keeps the
+ * old set if a value is out of range */
+typedef struct {
+    size_t split_min;           /* smallest remainder split off a block */
+    size_t fit_slack;           /* surplus of a new extension kept unsplit below this */
+    unsigned realloc_headroom;  /* percent added to a realloc that moves its block */
+    size_t grow_min;            /* growth step of the heap, doubling from grow_min */
+    size_t grow_max;            /* up to grow_max (0: extend by the missing bytes) */
+    unsigned grow_shift;        /* and at most heap size >> grow_shift */
+    size_t trim_threshold;      /* free bytes at the top released past this (0: never) */
+} mm_params_t;
+
+void mm_get_params(mm_params_t *p);
+int mm_set_params(const mm_params_t *p);
+
+/* Verify the whole heap, printing any inconsistency to stderr.
+ * Returns nonzero if the heap is consistent */
+int mm_check(void);
+
+/* Allocator statistics filled in by mm_stats. Byte counts of blocks
+ * include their header */
+#define MM_STATS_BINS   128
+typedef struct {
+    size_t heap_size;           /* bytes obtained from mem_sbrk */
+    size_t mmap_bytes;          /* bytes mapped for huge blocks */
+    unsigned long mmap_blocks;
+    size_t live_bytes;          /* allocated blocks and slab objects in the heap */
+    size_t free_bytes;          /* free blocks in the heap */
+    size_t deferred_bytes;      /* freed blocks not coalesced yet (QUICK_MAX_SIZE) */
+    size_t largest_free;        /* largest free block */
+    size_t bin_free_bytes[MM_STATS_BINS];   /* free bytes per free list bin */
+    unsigned long mallocs;      /* served from the heap (not thread caches) */
+    unsigned long frees;
+    unsigned long splits;
+    unsigned long coalesces[4]; /* by case: none, next, previous, both free */
+    unsigned long extends;
+    size_t extend_bytes;
+    unsigned long realloc_in_place;
+    unsigned long realloc_moves;
+    size_t requested_bytes;     /* sum of the sizes asked of mallocs */
+    size_t allocated_bytes;     /* sum of the block sizes that served them */
+    double internal_frag;       /* 1 - requested / allocated */
+} mm_stats_t;
+
+void mm_stats(mm_stats_t *st);
+
+/* Print a histogram of heap block sizes and slab objects to stdout */
+void mm_dump_histogram(void);
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, personal
@@ -0,0 +1,381 @@
+/*- -*- mode: c++; c-basic-offset: 4; -*-
+ *
+ * mm.hpp - header-only C++ interface to the allocator of mm.c (C++17).
+ *
+ * mm::allocator<T>
+ *      Stateless std::allocator replacement on mm_malloc. Deallocation is
+ *      sized and goes through mm_free_sized, which skips the lookups that
+ *      mm_free needs to find out what kind of block it got.
+ * mm::size_classes<Granule, Bins, ChunkSize>
+ *      Compile-time size class policy: Bins classes of Granule byte steps,
+ *      carved out of chunks of ChunkSize bytes. mm::no_classes sends every
+ *      request straight to mm_malloc.
+ * mm::pool<Policy>
+ *      Free lists of the policy's size classes, one per class, refilled by
+ *      carving headerless objects out of chunks taken from mm_malloc. Both
+ *      paths are inline and the class is a shift and a compare, so a
+ *      container gets a fast path specialized to its own sizes. Larger or
+ *      over-aligned requests go to mm_malloc and mm_memalign. Freed objects
+ *      stay in the pool; its destructor (or release) frees the chunks.
+ * mm::resource<Policy>
+ *      std::pmr::memory_resource on a pool<Policy>, for the pmr containers.
+ * mm::pool_allocator<T, Policy>
+ *      Allocator bound to a pool, or to the pool of a resource, calling it
+ *      inline rather than through the virtual functions of the resource.
+ *
+ * Pools and resources with size classes must not be used by two threads at
+ * the same time, like mm_arena_t. The stateless paths are as thread-safe as
+ * mm.c itself, i.e. when it is built with -DMM_THREADS.
+ *
+ * The heap must be initialized with mem_init and mm_init before the first
+ * allocation, except that defining MM_REPLACE_NEW in exactly one translation
+ * unit before including this header replaces the global operator new and
+ * delete with ones on mm.c that initialize it on first use. The sized
+ * operator delete then goes to mm_free_sized as well.
+ */
+#ifndef MM_HPP
+#define MM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+
+extern "C" {
+#include "mm.h"
+}
+
+namespace mm {
+
+/* Alignment of every payload mm_malloc returns (DSIZE in mm.c) */
+constexpr std::size_t alignment = 2 * sizeof(void *);
+
+/* Size class policy: class b holds objects of (b + 1) * Granule bytes, up to
+ * Bins * Granule. Granule must be a power of two and at least alignment, so
+ * that objects carved back to back stay aligned */
+template <std::size_t Granule, std::size_t Bins, std::size_t ChunkSize>
+struct size_classes {
+    static_assert(Granule >= alignment && (Granule & (Granule - 1)) == 0,
+                  "Granule must be a power of two of at least mm::alignment");
+    static_assert(Bins > 0, "a size class policy needs at least one class");
+    static_assert(ChunkSize >= alignment + Granule * Bins,
+                  "a chunk must hold at least one object of the largest class");
+
+    static constexpr std::size_t granule = Granule;
+    static constexpr std::size_t bin_count = Bins;
+    static constexpr std::size_t chunk_size = ChunkSize;
+    static constexpr std::size_t max_size = Granule * Bins;
+
+    static constexpr std::size_t bin(std::size_t size)
+    {
+        return size == 0 ? 0 : (size - 1) / Granule;
+    }
+
+    static constexpr std::size_t class_size(std::size_t bin)
+    {
+        return (bin + 1) * Granule;
+    }
+};
+
+/* No size classes, the pool only forwards to mm_malloc */
+struct no_classes {
+    static constexpr std::size_t bin_count = 0;
+    static constexpr std::size_t chunk_size = 0;
+    static constexpr std::size_t max_size = 0;
+};
+
+/* Nodes of lists, maps and hash tables: 16-byte steps up to the slab range
+ * of mm.c (256 bytes), in 64 KiB chunks */
+using node_classes = size_classes<16, 16, 64 * 1024>;
+
+namespace detail {
+
+/* mm_malloc and mm_free_sized under the operator new rules: a request of 0
+ * bytes gets a unique block, and failure throws */
+inline void *allocate(std::size_t size, std::size_t align)
+{
+    void *p;
+
+    if (size == 0)
+        size = 1;
+    p = align > alignment ? mm_memalign(align, size) : mm_malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+inline void deallocate(void *p, std::size_t size) noexcept
+{
+    mm_free_sized(p, size == 0 ? 1 : size);
+}
+
+template <class T>
+inline std::size_t array_bytes(std::size_t n)
+{
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+        throw std::bad_array_new_length();
+    return n * sizeof(T);
+}
+
+} // namespace detail
+
+/* Free lists per size class of Policy over chunks of mm_malloc */
+template <class Policy>
+class pool {
+public:
+    pool() noexcept = default;
+    pool(const pool &) = delete;
+    pool &operator=(const pool &) = delete;
+    ~pool() { release(); }
+
+    void *allocate(std::size_t size, std::size_t align = alignment)
+    {
+        if constexpr (Policy::bin_count != 0) {
+            if (size <= Policy::max_size && align <= alignment) {
+                std::size_t b = Policy::bin(size);
+                void *p = free_[b];
+                if (p != nullptr) {
+                    free_[b] = *static_cast<void **>(p);
+                    return p;
+                }
+                return carve(Policy::class_size(b));
+            }
+        }
+        return detail::allocate(size, align);
+    }
+
+    void deallocate(void *p, std::size_t size, std::size_t align = alignment) noexcept
+    {
+        if constexpr (Policy::bin_count != 0) {
+            if (size <= Policy::max_size && align <= alignment) {
+                std::size_t b = Policy::bin(size);
+                *static_cast<void **>(p) = free_[b];
+                free_[b] = p;
+                return;
+            }
+        }
+        detail::deallocate(p, size);
+    }
+
+    /* Free all chunks. Objects of the size classes die with them, larger
+     * ones are not tracked and must have been deallocated */
+    void release() noexcept
+    {
+        while (chunks_ != nullptr) {
+            void *next = *static_cast<void **>(chunks_);
+            mm_free_sized(chunks_, Policy::chunk_size);
+            chunks_ = next;
+        }
+        for (void *&head : free_)
+            head = nullptr;
+        cur_ = end_ = nullptr;
+    }
+
+private:
+    /* Bump allocate from the current chunk; the tail of a chunk too short
+     * for the object is left unused */
+    void *carve(std::size_t csize)
+    {
+        if (static_cast<std::size_t>(end_ - cur_) < csize) {
+            void *chunk = detail::allocate(Policy::chunk_size, alignment);
+            *static_cast<void **>(chunk) = chunks_;
+            chunks_ = chunk;
+            cur_ = static_cast<char *>(chunk) + alignment;
+            end_ = static_cast<char *>(chunk) + Policy::chunk_size;
+        }
+        void *p = cur_;
+        cur_ += csize;
+        return p;
+    }
+
+    void *free_[Policy::bin_count != 0 ? Policy::bin_count : 1] = {};
+    char *cur_ = nullptr;
+    char *end_ = nullptr;
+    void *chunks_ = nullptr;     /* newest chunk, its first word links to the older */
+};
+
+/* std::pmr::memory_resource on a pool. Without size classes all instances
+ * draw from the same heap and compare equal */
+template <class Policy = no_classes>
+class resource : public std::pmr::memory_resource {
+public:
+    pool<Policy> &get_pool() noexcept { return pool_; }
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        return pool_.allocate(bytes, align);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override
+    {
+        pool_.deallocate(p, bytes, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        if constexpr (Policy::bin_count == 0)
+            return dynamic_cast<const resource *>(&other) != nullptr;
+        else
+            return this == &other;
+    }
+
+private:
+    pool<Policy> pool_;
+};
+
+/* The resource without size classes, e.g. for std::pmr::set_default_resource */
+inline std::pmr::memory_resource *default_resource() noexcept
+{
+    static resource<no_classes> r;
+    return &r;
+}
+
+/* Stateless allocator on mm_malloc with sized deallocation */
+template <class T>
+class allocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using is_always_equal = std::true_type;
+
+    allocator() noexcept = default;
+    template <class U>
+    allocator(const allocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(detail::allocate(detail::array_bytes<T>(n), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept
+    {
+        detail::deallocate(p, n * sizeof(T));
+    }
+};
+
+template <class T, class U>
+inline bool operator==(const allocator<T> &, const allocator<U> &) noexcept { return true; }
+template <class T, class U>
+inline bool operator!=(const allocator<T> &, const allocator<U> &) noexcept { return false; }
+
+/* Allocator on a pool of Policy, which must outlive the containers using it */
+template <class T, class Policy = node_classes>
+class pool_allocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    explicit pool_allocator(pool<Policy> &p) noexcept : pool_(&p) {}
+    explicit pool_allocator(resource<Policy> &r) noexcept : pool_(&r.get_pool()) {}
+    template <class U>
+    pool_allocator(const pool_allocator<U, Policy> &other) noexcept : pool_(other.get_pool()) {}
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(pool_->allocate(detail::array_bytes<T>(n), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept
+    {
+        pool_->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    pool<Policy> *get_pool() const noexcept { return pool_; }
+
+private:
+    pool<Policy> *pool_;
+};
+
+template <class T, class U, class Policy>
+inline bool operator==(const pool_allocator<T, Policy> &a, const pool_allocator<U, Policy> &b) noexcept
+{
+    return a.get_pool() == b.get_pool();
+}
+template <class T, class U, class Policy>
+inline bool operator!=(const pool_allocator<T, Policy> &a, const pool_allocator<U, Policy> &b) noexcept
+{
+    return a.get_pool() != b.get_pool();
+}
+
+} // namespace mm
+
+#ifdef MM_REPLACE_NEW
+extern "C" void mem_init(void);
+
+namespace mm {
+namespace detail {
+
+/* Initialize the heap on the first operator new, which may come from a
+ * static constructor */
+inline void new_init()
+{
+    static const bool ready = (mem_init(), mm_init() == 0);
+    if (!ready)
+        throw std::bad_alloc();
+}
+
+} // namespace detail
+} // namespace mm
+
+/* The nothrow forms and the unsized array forms left to the library call
+ * these, as the standard requires of the default versions */
+void *operator new(std::size_t size)
+{
+    mm::detail::new_init();
+    return mm::detail::allocate(size, mm::alignment);
+}
+
+void *operator new[](std::size_t size)
+{
+    mm::detail::new_init();
+    return mm::detail::allocate(size, mm::alignment);
+}
+
+void *operator new(std::size_t size, std::align_val_t align)
+{
+    mm::detail::new_init();
+    return mm::detail::allocate(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+    mm::detail::new_init();
+    return mm::detail::allocate(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *p) noexcept { mm_free(p); }
+void operator delete[](void *p) noexcept { mm_free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { mm_free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { mm_free(p); }
+
+void operator delete(void *p, std::size_t size) noexcept
+{
+    if (p != nullptr)
+        mm::detail::deallocate(p, size);
+}
+
+void operator delete[](void *p, std::size_t size) noexcept
+{
+    if (p != nullptr)
+        mm::detail::deallocate(p, size);
+}
+
+void operator delete(void *p, std::size_t size, std::align_val_t) noexcept
+{
+    if (p != nullptr)
+        mm::detail::deallocate(p, size);
+}
+
+void operator delete[](void *p, std::size_t size, std::align_val_t) noexcept
+{
+    if (p != nullptr)
+        mm::detail::deallocate(p, size);
+}
+#endif /* MM_REPLACE_NEW */
+
+#endif /* MM_HPP */
@@ -0,0 +1,465 @@
+/*
+ * mm_bench.c - trace replay benchmark for mm.c, built from source.
+ *
+ * usage: mm_bench [-t tracedir] [-f tracefile]... [-n reps] [-w warmup]
+ *                 [-g] [-j] [-c] [-b baseline.json] [-r pct]
+ *        mm_bench -p MB
+ *
+ * Replays the .rep traces (the mdriver default set unless -f is given)
+ * warmup + reps times each.  For every trace it reports throughput in
+ * Kops/sec over the measured runs, the 50th/99th/99.9th percentile latency
+ * of a single malloc/realloc/free call in cycles, the peak utilization
+ * (peak live payload / peak heap size) and whether the replay was valid
+ * (aligned payloads whose contents survive until they are freed).
+ *
+ *   -g  also replay against the libc malloc, side by side
+ *   -j  print the results as JSON, one trace per line; save this output
+ *       to use it as a baseline later
+ *   -c  print the heap size curve (op, heap bytes, live bytes) of each
+ *       trace, as the heap_curve field under -j
+ *   -b  compare with a baseline saved by -j; exits with status 2 if any
+ *       trace lost more than pct percent (-r, 5 by default) of throughput
+ *       or utilization. Under -j the mm lines get the base_kops, dkops,
+ *       dutil and regression fields
+ *   -p  free path microbenchmark instead of the traces: fill a heap of MB
+ *       megabytes (make it larger than the last level cache) and free
+ *       half of its blocks in random order, with mm_heap_free and then
+ *       mm_heap_free_sized. Reports cycles and cache misses per free;
+ *       build with "make clean && make PREFETCH=0 mm_bench" to compare
+ *       against the allocator without prefetching
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "mm_replay.h"
+
+#define MAX_TRACES      64
+#define CURVE_POINTS    64      /* heap curve samples per trace */
+
+static const char *default_traces[] = {
+    "amptjp-bal.rep", "cccp-bal.rep", "cp-decl-bal.rep", "expr-bal.rep",
+    "coalescing-bal.rep", "random-bal.rep", "random2-bal.rep",
+    "binary-bal.rep", "binary2-bal.rep", "realloc-bal.rep", "realloc2-bal.rep",
+};
+
+typedef struct {
+    uint32_t op;
+    size_t heap;
+    size_t live;
+} curve_pt_t;
+
+typedef struct {
+    int valid;
+    double kops;
+    uint64_t p50, p99, p999;
+    double util;                /* negative when the heap size is unknown */
+    int ncurve;
+    curve_pt_t curve[CURVE_POINTS + 1];
+} result_t;
+
+/* Comparison of an mm result with the baseline */
+typedef struct {
+    int found;
+    double base_kops;
+    double dkops;               /* percent */
+    double dutil;               /* percentage points */
+    int worse;
+} delta_t;
+
+/* Heap curve of a replay in the making */
+typedef struct {
+    const allocator_t *a;
+    result_t *r;
+    int step;
+    int last;
+} curve_arg_t;
+
+static int mm_reset(void)
+{
+    mem_reset_brk();
+    return mm_init();
+}
+
+static const allocator_t mm_allocator = {
+    "mm", mm_reset, mm_malloc, mm_realloc, mm_free, mem_heapsize
+};
+static const allocator_t libc_allocator = {
+    "libc", NULL, malloc, realloc, free, NULL
+};
+
+/* Sample the heap every step ops and after the last one */
+static void curve_hook(void *arg, int op, size_t live)
+{
+    curve_arg_t *c = arg;
+
+    if (op % c->step == 0 || op == c->last) {
+        curve_pt_t *pt = &c->r->curve[c->r->ncurve++];
+        pt->op = op;
+        pt->heap = c->a->heap_size ? c->a->heap_size() : 0;
+        pt->live = live;
+    }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**********************************************************
+ * bench
+ * warmup unmeasured runs, then reps measured ones
+ **********************************************************/
+static void bench(const allocator_t *a, const trace_t *t, int warmup, int reps, result_t *r)
+{
+    size_t n = (size_t)t->num_ops * reps;
+    uint64_t *lat = malloc(n * sizeof(uint64_t));
+    curve_arg_t curve = { a, r, (t->num_ops + CURVE_POINTS - 1) / CURVE_POINTS, t->num_ops - 1 };
+    double secs = 0, s;
+    int i;
+
+    memset(r, 0, sizeof(*r));
+    for (i = 0; i < warmup; i++) {
+        if (replay(a, t, NULL, NULL, NULL, &r->util) < 0)
+            goto out;
+    }
+    for (i = 0; i < reps; i++) {
+        /* The heap curve comes from the first measured run */
+        s = replay(a, t, lat + (size_t)i * t->num_ops, i == 0 ? curve_hook : NULL, &curve, &r->util);
+        if (s < 0)
+            goto out;
+        secs += s;
+    }
+
+    qsort(lat, n, sizeof(uint64_t), cmp_u64);
+    r->valid = 1;
+    r->kops = n / secs / 1000.0;
+    r->p50 = lat[n * 50 / 100];
+    r->p99 = lat[n * 99 / 100];
+    r->p999 = lat[n * 999 / 1000];
+out:
+    free(lat);
+}
+
+/**********************************************************
+ * print_json
+ * One result as a JSON line, with the baseline comparison d
+ * and the heap curve when they are given
+ **********************************************************/
+static void print_json(const char *alloc, const trace_t *t, const result_t *r,
+                       const delta_t *d, int curve)
+{
+    int i;
+
+    printf("{\"allocator\": \"%s\", \"name\": \"%s\", \"ops\": %d, \"valid\": %d, "
+           "\"kops\": %.1f, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"util\": %.4f",
+           alloc, t->name, t->num_ops, r->valid, r->kops,
+           (unsigned long long)r->p50, (unsigned long long)r->p99,
+           (unsigned long long)r->p999, r->util);
+    if (d != NULL && d->found)
+        printf(", \"base_kops\": %.1f, \"dkops\": %.2f, \"dutil\": %.2f, \"regression\": %d",
+               d->base_kops, d->dkops, d->dutil, d->worse);
+    else if (d != NULL)
+        printf(", \"base_kops\": null, \"dkops\": null, \"dutil\": null, \"regression\": 0");
+    if (curve) {
+        printf(", \"heap_curve\": [");
+        for (i = 0; i < r->ncurve; i++)
+            printf("%s[%u, %zu, %zu]", i ? ", " : "", r->curve[i].op, r->curve[i].heap, r->curve[i].live);
+        printf("]");
+    }
+    printf("}\n");
+}
+
+static void print_curve(const trace_t *t, const result_t *r)
+{
+    int i;
+
+    printf("heap curve of %s (op, heap bytes, live bytes):\n", t->name);
+    for (i = 0; i < r->ncurve; i++)
+        printf("  %8u %10zu %10zu\n", r->curve[i].op, r->curve[i].heap, r->curve[i].live);
+}
+
+/**********************************************************
+ * baseline_find
+ * Look up the mm result of trace name in a baseline written
+ * by -j. Return 1 and fill kops and util if found
+ **********************************************************/
+static int baseline_find(FILE *fp, const char *name, double *kops, double *util)
+{
+    char key[96];
+    char *line = NULL;
+    size_t cap = 0;
+    int found = 0;
+
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    rewind(fp);
+    while (getline(&line, &cap, fp) > 0) {
+        char *k, *u;
+        if (strstr(line, "\"allocator\": \"mm\"") == NULL || strstr(line, key) == NULL)
+            continue;
+        if ((k = strstr(line, "\"kops\": ")) == NULL || (u = strstr(line, "\"util\": ")) == NULL)
+            continue;
+        *kops = atof(k + 8);
+        *util = atof(u + 8);
+        found = 1;
+        break;
+    }
+    free(line);
+    return found;
+}
+
+/**********************************************************
+ * compare
+ * Compare the mm result r of trace name with the baseline.
+ * A trace is worse if it lost more than max_loss percent of
+ * throughput or max_loss points of utilization
+ **********************************************************/
+static void compare(FILE *fp, const char *name, const result_t *r, double max_loss, delta_t *d)
+{
+    double base_util;
+
+    memset(d, 0, sizeof(*d));
+    if (!baseline_find(fp, name, &d->base_kops, &base_util) || d->base_kops <= 0)
+        return;
+    d->found = 1;
+    d->dkops = (r->kops - d->base_kops) / d->base_kops * 100;
+    d->dutil = (r->util - base_util) * 100;
+    d->worse = d->dkops < -max_loss || d->dutil < -max_loss;
+}
+
+/**********************************************************
+ * open_miss_counter
+ * Count the cache misses of this process in user space.
+ * Return -1 where no hardware counter is available
+ **********************************************************/
+static int open_miss_counter(void)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**********************************************************
+ * free_pass
+ * Fill a new heap of mb megabytes with blocks of 256 to 768
+ * bytes, then free every other one in a shuffled order with
+ * mm_heap_free or mm_heap_free_sized. The freed blocks have
+ * live neighbours or coalesce, so both the boundary tags and
+ * the free list links are touched all over the heap
+ **********************************************************/
+static void free_pass(size_t mb, int sized, int fd)
+{
+    size_t bytes = mb << 20, n = bytes / 512, count = 0, i;
+    mm_heap_t *h = mm_heap_create(bytes + (bytes >> 2));
+    void **ptrs = malloc(n * sizeof(void *));
+    size_t *sizes = malloc(n * sizeof(size_t));
+    size_t *order = malloc(n / 2 * sizeof(size_t));
+    uint64_t misses = 0, t0, t1;
+
+    if (h == NULL || ptrs == NULL || sizes == NULL || order == NULL) {
+        fprintf(stderr, "free pass: out of memory\n");
+        exit(1);
+    }
+    srand(1);
+    for (count = 0; count < n; count++) {
+        sizes[count] = 256 + rand() % 513;
+        if ((ptrs[count] = mm_heap_malloc(h, sizes[count])) == NULL)
+            break;
+        memset(ptrs[count], 0, 16);
+    }
+    for (i = 0; i < count / 2; i++)
+        order[i] = 2 * i + (rand() & 1);
+    for (i = count / 2; i > 1; i--) {
+        size_t j = rand() % i, tmp = order[i - 1];
+        order[i - 1] = order[j];
+        order[j] = tmp;
+    }
+
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    t0 = read_cycles();
+    if (sized) {
+        for (i = 0; i < count / 2; i++)
+            mm_heap_free_sized(h, ptrs[order[i]], sizes[order[i]]);
+    } else {
+        for (i = 0; i < count / 2; i++)
+            mm_heap_free(h, ptrs[order[i]]);
+    }
+    t1 = read_cycles();
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+            misses = 0;
+    }
+
+    printf("%-20s %10zu %12.1f", sized ? "mm_heap_free_sized" : "mm_heap_free",
+           count / 2, (double)(t1 - t0) / (count / 2));
+    if (fd >= 0)
+        printf(" %12.2f\n", (double)misses / (count / 2));
+    else
+        printf(" %12s\n", "-");
+
+    mm_heap_destroy(h);
+    free(ptrs);
+    free(sizes);
+    free(order);
+}
+
+static void free_bench(size_t mb)
+{
+    int fd = open_miss_counter();
+
+    printf("free path on a %zu MB heap%s\n", mb, fd < 0 ? " (no cache miss counter)" : "");
+    printf("%-20s %10s %12s %12s\n", "call", "frees", "cycles/free", "misses/free");
+    free_pass(mb, 0, fd);
+    free_pass(mb, 1, fd);
+    if (fd >= 0)
+        close(fd);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t tracedir] [-f tracefile]... [-n reps] [-w warmup]\n"
+            "          [-g] [-j] [-c] [-b baseline.json] [-r pct]\n"
+            "       %s -p MB\n", prog, prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = "../traces";
+    const char *files[MAX_TRACES];
+    int nfiles = 0;
+    int reps = 10, warmup = 2;
+    int with_libc = 0, json = 0, curve = 0;
+    const char *baseline = NULL;
+    double max_loss = 5.0;
+    FILE *base_fp = NULL;
+    trace_t trace;
+    result_t mm, libc;
+    delta_t delta;
+    int c, i, all_valid = 1, regressed = 0;
+
+    while ((c = getopt(argc, argv, "t:f:n:w:gjcb:r:p:h")) != -1) {
+        switch (c) {
+        case 't':
+            dir = optarg;
+            break;
+        case 'f':
+            if (nfiles < MAX_TRACES)
+                files[nfiles++] = optarg;
+            break;
+        case 'n':
+            reps = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 'g':
+            with_libc = 1;
+            break;
+        case 'j':
+            json = 1;
+            break;
+        case 'c':
+            curve = 1;
+            break;
+        case 'b':
+            baseline = optarg;
+            break;
+        case 'r':
+            max_loss = atof(optarg);
+            break;
+        case 'p':
+            free_bench(strtoul(optarg, NULL, 10));
+            return 0;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (reps < 1)
+        reps = 1;
+    if (nfiles == 0) {
+        for (i = 0; i < (int)(sizeof(default_traces) / sizeof(default_traces[0])); i++)
+            files[nfiles++] = default_traces[i];
+    } else {
+        dir = NULL;
+    }
+    if (baseline != NULL && (base_fp = fopen(baseline, "r")) == NULL) {
+        perror(baseline);
+        return 1;
+    }
+
+    mem_init();
+
+    if (!json) {
+        printf("%d warm-up + %d measured runs per trace, latencies in cycles\n", warmup, reps);
+        printf("%-20s %5s %10s %8s %8s %8s %6s", "trace", "valid", "mm Kops", "p50", "p99", "p999", "util");
+        if (with_libc)
+            printf(" %10s %8s %8s %8s", "libc Kops", "p50", "p99", "p999");
+        if (base_fp)
+            printf(" %10s %7s %7s", "base Kops", "dKops", "dutil");
+        printf("\n");
+    }
+
+    for (i = 0; i < nfiles; i++) {
+        if (!read_trace(dir, files[i], &trace)) {
+            all_valid = 0;
+            continue;
+        }
+        bench(&mm_allocator, &trace, warmup, reps, &mm);
+        if (with_libc)
+            bench(&libc_allocator, &trace, warmup, reps, &libc);
+        all_valid &= mm.valid;
+        if (base_fp) {
+            compare(base_fp, trace.name, &mm, max_loss, &delta);
+            regressed |= delta.worse;
+        }
+
+        if (json) {
+            print_json("mm", &trace, &mm, base_fp ? &delta : NULL, curve);
+            if (with_libc)
+                print_json("libc", &trace, &libc, NULL, curve);
+        } else {
+            printf("%-20s %5s %10.0f %8llu %8llu %8llu %5.0f%%", trace.name, mm.valid ? "yes" : "no",
+                   mm.kops, (unsigned long long)mm.p50, (unsigned long long)mm.p99,
+                   (unsigned long long)mm.p999, mm.util * 100);
+            if (with_libc)
+                printf(" %10.0f %8llu %8llu %8llu", libc.kops, (unsigned long long)libc.p50,
+                       (unsigned long long)libc.p99, (unsigned long long)libc.p999);
+            if (base_fp && delta.found)
+                printf(" %10.0f %+6.1f%% %+6.1f%s", delta.base_kops, delta.dkops, delta.dutil,
+                       delta.worse ? "  REGRESSION" : "");
+            else if (base_fp)
+                printf(" %10s", "-");
+            printf("\n");
+            if (curve)
+                print_curve(&trace, &mm);
+        }
+        free(trace.ops);
+    }
+
+    if (base_fp)
+        fclose(base_fp);
+    mem_deinit();
+    if (!all_valid)
+        return 1;
+    return regressed ? 2 : 0;
+}
@@ -0,0 +1,493 @@
+/*
+ * mm_record.c - LD_PRELOAD recorder of allocation traces in .rep format.
+ *
+ * usage: MM_RECORD_FILE=app.rep LD_PRELOAD=./mm_record.so app ...
+ *
+ * Interposes malloc, calloc, realloc, free and the aligned allocation
+ * calls of a live process and forwards them to the next allocator (the
+ * libc one), so recording does not change what it records.  Every block
+ * gets a new id; the calls are written as the "a id size", "r id size"
+ * and "f id" lines that mdriver, mm_bench and mm_tracegen read.  Ids skip
+ * those with a low byte of 128-255 (see NEXT_ID), which mdriver cannot
+ * realloc.  Blocks
+ * still live at exit are freed at the end of the trace, so it is balanced
+ * like the -bal traces.  A %p in MM_RECORD_FILE is replaced by the process
+ * id, so that programs the recorded one runs get traces of their own; the
+ * file is mm_record.%p.rep when MM_RECORD_FILE is not set.  A forked child
+ * that does not exec stops recording; the parent keeps going.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/* Header lines are written blank and filled in at exit: heap size hint
+ * (peak live bytes), number of ids, number of ops and weight */
+#define HDR_WIDTH       20
+#define HDR_LINES       4
+
+#define MIN(x,y) ((x) < (y)?(x) :(y))
+
+#define OUT_BUF_SIZE    (64 * 1024)
+#define TABLE_MIN       (1 << 16)
+
+/* Allocations made by dlsym while the real functions are looked up */
+#define BOOT_SIZE       4096
+
+typedef struct {
+    uintptr_t ptr;              /* 0 for an empty slot */
+    size_t id;
+} entry_t;
+
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+
+static char boot_buf[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used;
+static int resolving;
+
+static pthread_mutex_t rec_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread int in_hook __attribute__((tls_model("initial-exec")));
+static int rec_fd = -1;
+static int rec_done;
+static char out_buf[OUT_BUF_SIZE];
+static size_t out_len;
+
+/* Live blocks: open addressing with linear probing on the address */
+static entry_t *table;
+static size_t table_cap, table_count;
+
+/* The id after id. mdriver fills a payload with a byte derived from its id
+ * and, after a realloc, compares it as a signed char with the unsigned one
+ * it wrote, so it reports ids with a low byte of 128-255 as not preserved.
+ * Those ids are never handed out */
+#define NEXT_ID(id)     ((((id) + 1) & 0xFF) == 128 ? (id) + 129 : (id) + 1)
+
+static size_t next_id, num_ops;
+static size_t live_bytes, peak_bytes;
+static size_t *id_size;         /* size of each id, for the live byte count */
+static size_t id_cap;
+
+/**********************************************************
+ * map_array
+ * Zeroed memory for the recorder's own tables, taken from
+ * mmap so that it never goes through the hooks
+ **********************************************************/
+static void *map_array(size_t bytes)
+{
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/**********************************************************
+ * out_flush
+ * Write the buffered ops, then the header for what has been
+ * written, so that a process leaving through _exit or exec
+ * still leaves a valid (if unbalanced) trace of all but its
+ * last buffer
+ **********************************************************/
+static void out_flush(void)
+{
+    char hdr[HDR_LINES * (HDR_WIDTH + 1) + 1];
+    size_t off = 0;
+
+    while (off < out_len && rec_fd >= 0) {
+        ssize_t n = write(rec_fd, out_buf + off, out_len - off);
+        if (n <= 0)
+            break;
+        off += n;
+    }
+    out_len = 0;
+    snprintf(hdr, sizeof(hdr), "%*zu\n%*zu\n%*zu\n%*d\n",
+             HDR_WIDTH, peak_bytes < INT_MAX ? peak_bytes : INT_MAX,
+             HDR_WIDTH, next_id, HDR_WIDTH, num_ops, HDR_WIDTH, 1);
+    if (rec_fd >= 0 && pwrite(rec_fd, hdr, HDR_LINES * (HDR_WIDTH + 1), 0) < 0)
+        rec_done = 1;
+}
+
+static void out_op(char type, size_t id, size_t size)
+{
+    if (out_len + 64 > OUT_BUF_SIZE)
+        out_flush();
+    if (type == 'f')
+        out_len += snprintf(out_buf + out_len, 64, "f %zu\n", id);
+    else
+        out_len += snprintf(out_buf + out_len, 64, "%c %zu %zu\n", type, id, size);
+    num_ops++;
+}
+
+static inline size_t hash_ptr(uintptr_t p, size_t cap)
+{
+    return ((p >> 4) * 0x9e3779b97f4a7c15ull) >> 7 & (cap - 1);
+}
+
+static void table_put(uintptr_t ptr, size_t id);
+static int rec_open(void);
+
+static int table_grow(void)
+{
+    entry_t *old = table;
+    size_t old_cap = table_cap, i;
+    size_t cap = old_cap ? old_cap * 2 : TABLE_MIN;
+    entry_t *t = map_array(cap * sizeof(entry_t));
+
+    if (t == NULL)
+        return 0;
+    table = t;
+    table_cap = cap;
+    table_count = 0;
+    for (i = 0; i < old_cap; i++) {
+        if (old[i].ptr != 0)
+            table_put(old[i].ptr, old[i].id);
+    }
+    if (old != NULL)
+        munmap(old, old_cap * sizeof(entry_t));
+    return 1;
+}
+
+static void table_put(uintptr_t ptr, size_t id)
+{
+    size_t i = hash_ptr(ptr, table_cap);
+    while (table[i].ptr != 0)
+        i = (i + 1) & (table_cap - 1);
+    table[i].ptr = ptr;
+    table[i].id = id;
+    table_count++;
+}
+
+/**********************************************************
+ * table_take
+ * Remove ptr from the live table and return its id, or
+ * SIZE_MAX if the block was not recorded. The entries after
+ * it in the probe run are shifted back over the hole
+ **********************************************************/
+static size_t table_take(uintptr_t ptr)
+{
+    size_t i, j, id;
+
+    if (table_cap == 0)
+        return SIZE_MAX;
+    for (i = hash_ptr(ptr, table_cap); table[i].ptr != ptr; i = (i + 1) & (table_cap - 1)) {
+        if (table[i].ptr == 0)
+            return SIZE_MAX;
+    }
+    id = table[i].id;
+    table_count--;
+    for (j = (i + 1) & (table_cap - 1); table[j].ptr != 0; j = (j + 1) & (table_cap - 1)) {
+        size_t home = hash_ptr(table[j].ptr, table_cap);
+        /* Move the entry back if its home is not in (i, j] */
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            table[i] = table[j];
+            i = j;
+        }
+    }
+    table[i].ptr = 0;
+    return id;
+}
+
+static int set_id_size(size_t id, size_t size)
+{
+    if (id >= id_cap) {
+        size_t cap = id_cap ? id_cap * 2 : TABLE_MIN;
+        size_t *sizes;
+        while (cap <= id)
+            cap *= 2;
+        if ((sizes = map_array(cap * sizeof(size_t))) == NULL)
+            return 0;
+        if (id_size != NULL) {
+            memcpy(sizes, id_size, id_cap * sizeof(size_t));
+            munmap(id_size, id_cap * sizeof(size_t));
+        }
+        id_size = sizes;
+        id_cap = cap;
+    }
+    live_bytes += size - id_size[id];
+    id_size[id] = size;
+    if (live_bytes > peak_bytes)
+        peak_bytes = live_bytes;
+    return 1;
+}
+
+/**********************************************************
+ * record_alloc, record_free, record_realloc
+ * Log one call under rec_lock. Calls made while recording is
+ * off, or for blocks the recorder never saw, are skipped
+ **********************************************************/
+static void record_alloc(void *p, size_t size)
+{
+    if (p == NULL || size == 0)
+        return;
+    pthread_mutex_lock(&rec_lock);
+    if (!rec_done && (rec_fd >= 0 || rec_open()) &&
+        (table_count * 2 < table_cap || table_grow()) && set_id_size(next_id, size)) {
+        table_put((uintptr_t)p, next_id);
+        out_op('a', next_id, size);
+        next_id = NEXT_ID(next_id);
+    }
+    pthread_mutex_unlock(&rec_lock);
+}
+
+static void record_free(void *p)
+{
+    size_t id;
+
+    if (p == NULL)
+        return;
+    pthread_mutex_lock(&rec_lock);
+    if (!rec_done && (id = table_take((uintptr_t)p)) != SIZE_MAX) {
+        set_id_size(id, 0);
+        out_op('f', id, 0);
+    }
+    pthread_mutex_unlock(&rec_lock);
+}
+
+static void record_realloc(void *old, void *p, size_t size)
+{
+    size_t id;
+
+    pthread_mutex_lock(&rec_lock);
+    if (!rec_done && (id = table_take((uintptr_t)old)) != SIZE_MAX) {
+        table_put((uintptr_t)p, id);
+        set_id_size(id, size);
+        out_op('r', id, size);
+    }
+    pthread_mutex_unlock(&rec_lock);
+}
+
+static void atfork_child(void)
+{
+    rec_done = 1;
+    rec_fd = -1;
+    pthread_mutex_init(&rec_lock, NULL);
+}
+
+/**********************************************************
+ * resolve
+ * Look up the next allocator's functions. dlsym may itself
+ * allocate, which boot_alloc serves meanwhile
+ **********************************************************/
+static void resolve(void)
+{
+    resolving = 1;
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    resolving = 0;
+    pthread_atfork(NULL, NULL, atfork_child);
+}
+
+/**********************************************************
+ * rec_open
+ * Create the trace file on the first recorded malloc, so that
+ * processes which allocate nothing leave no file, and write
+ * the blank header. Called with rec_lock held
+ **********************************************************/
+static int rec_open(void)
+{
+    const char *path, *pid;
+    char name[PATH_MAX], hdr[HDR_LINES * (HDR_WIDTH + 1)];
+    int i;
+
+    if ((path = getenv("MM_RECORD_FILE")) == NULL)
+        path = "mm_record.%p.rep";
+    if ((pid = strstr(path, "%p")) != NULL)
+        snprintf(name, sizeof(name), "%.*s%d%s", (int)(pid - path), path, (int)getpid(), pid + 2);
+    else
+        snprintf(name, sizeof(name), "%s", path);
+    rec_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    memset(hdr, ' ', sizeof(hdr));
+    for (i = 1; i <= HDR_LINES; i++)
+        hdr[i * (HDR_WIDTH + 1) - 1] = '\n';
+    if (rec_fd >= 0 && write(rec_fd, hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr)) {
+        close(rec_fd);
+        rec_fd = -1;
+    }
+    if (rec_fd < 0)
+        rec_done = 1;
+    return rec_fd >= 0;
+}
+
+static void *boot_alloc(size_t size)
+{
+    void *p;
+
+    size = (size + 15) & ~(size_t)15;
+    if (boot_used + size > BOOT_SIZE)
+        return NULL;
+    p = boot_buf + boot_used;
+    boot_used += size;
+    return p;
+}
+
+static inline int is_boot(void *p)
+{
+    return (char *)p >= boot_buf && (char *)p < boot_buf + BOOT_SIZE;
+}
+
+/**********************************************************
+ * record_fini
+ * Free the blocks still live and flush the ops. Runs as late
+ * as a destructor can; calls after it are forwarded without
+ * being recorded
+ **********************************************************/
+__attribute__((destructor(101)))
+static void record_fini(void)
+{
+    size_t i;
+
+    pthread_mutex_lock(&rec_lock);
+    if (!rec_done && rec_fd >= 0) {
+        for (i = 0; i < table_cap; i++) {
+            if (table[i].ptr != 0)
+                out_op('f', table[i].id, 0);
+        }
+        out_flush();
+        close(rec_fd);
+        rec_fd = -1;
+    }
+    rec_done = 1;
+    pthread_mutex_unlock(&rec_lock);
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL) {
+        if (resolving)
+            return boot_alloc(size);
+        resolve();
+    }
+    p = real_malloc(size);
+    if (!in_hook) {
+        in_hook = 1;
+        record_alloc(p, size);
+        in_hook = 0;
+    }
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (real_calloc == NULL) {
+        if (resolving) {
+            if (size != 0 && nmemb > SIZE_MAX / size)
+                return NULL;
+            return boot_alloc(nmemb * size);       /* static, so zero */
+        }
+        resolve();
+    }
+    p = real_calloc(nmemb, size);
+    if (!in_hook && p != NULL) {
+        in_hook = 1;
+        record_alloc(p, nmemb * size);
+        in_hook = 0;
+    }
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (real_realloc == NULL) {
+        if (resolving)
+            return NULL;
+        resolve();
+    }
+    if (ptr != NULL && is_boot(ptr)) {
+        /* Move a bootstrap block to the real heap */
+        if ((p = real_malloc(size)) != NULL)
+            memcpy(p, ptr, MIN(size, (size_t)(boot_buf + BOOT_SIZE - (char *)ptr)));
+        return p;
+    }
+    p = real_realloc(ptr, size);
+    if (!in_hook) {
+        in_hook = 1;
+        if (ptr == NULL)
+            record_alloc(p, size);
+        else if (size == 0)
+            record_free(ptr);
+        else if (p != NULL)
+            record_realloc(ptr, p, size);
+        in_hook = 0;
+    }
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || is_boot(ptr))
+        return;
+    if (real_free == NULL)
+        resolve();
+    if (!in_hook) {
+        in_hook = 1;
+        record_free(ptr);
+        in_hook = 0;
+    }
+    real_free(ptr);
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    int ret;
+
+    if (real_posix_memalign == NULL)
+        resolve();
+    ret = real_posix_memalign(memptr, align, size);
+    if (ret == 0 && !in_hook) {
+        in_hook = 1;
+        record_alloc(*memptr, size);
+        in_hook = 0;
+    }
+    return ret;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_aligned_alloc == NULL)
+        resolve();
+    p = real_aligned_alloc(align, size);
+    if (!in_hook) {
+        in_hook = 1;
+        record_alloc(p, size);
+        in_hook = 0;
+    }
+    return p;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_memalign == NULL)
+        resolve();
+    p = real_memalign(align, size);
+    if (!in_hook) {
+        in_hook = 1;
+        record_alloc(p, size);
+        in_hook = 0;
+    }
+    return p;
+}
@@ -0,0 +1,169 @@
+/*
+ * mm_replay.c - read .rep traces and replay them on an allocator.
+ *
+ * A replay checks that every payload is aligned and keeps its contents
+ * until it is reallocated or freed, through a tag byte at both ends.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm_replay.h"
+
+#define ALIGNMENT       16
+
+/**********************************************************
+ * read_trace
+ * Parse a .rep file: suggested heap size, number of ids,
+ * number of ops and weight, then one "a id size",
+ * "r id size" or "f id" per line. dir may be NULL
+ **********************************************************/
+int read_trace(const char *dir, const char *file, trace_t *t)
+{
+    char path[1024];
+    FILE *fp;
+    int heap_hint, weight, i;
+
+    if (dir != NULL)
+        snprintf(path, sizeof(path), "%s/%s", dir, file);
+    else
+        snprintf(path, sizeof(path), "%s", file);
+    if ((fp = fopen(path, "r")) == NULL) {
+        perror(path);
+        return 0;
+    }
+    snprintf(t->name, sizeof(t->name), "%.63s", strrchr(path, '/') ? strrchr(path, '/') + 1 : path);
+
+    if (fscanf(fp, "%d %d %d %d", &heap_hint, &t->num_ids, &t->num_ops, &weight) != 4 ||
+        t->num_ids <= 0 || t->num_ops <= 0) {
+        fprintf(stderr, "%s: bad trace header\n", path);
+        fclose(fp);
+        return 0;
+    }
+    if ((t->ops = malloc(t->num_ops * sizeof(trace_op_t))) == NULL) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        fclose(fp);
+        return 0;
+    }
+    for (i = 0; i < t->num_ops; i++) {
+        trace_op_t *op = &t->ops[i];
+        int n;
+        if (fscanf(fp, " %c %d", &op->type, &op->id) != 2)
+            break;
+        op->size = 0;
+        if (op->type == 'a' || op->type == 'r')
+            n = fscanf(fp, "%zu", &op->size);
+        else
+            n = op->type == 'f';
+        if (n != 1 || op->id < 0 || op->id >= t->num_ids)
+            break;
+    }
+    fclose(fp);
+    if (i != t->num_ops) {
+        fprintf(stderr, "%s: bad op %d\n", path, i);
+        free(t->ops);
+        return 0;
+    }
+    return 1;
+}
+
+/* Byte written at both ends of every payload and checked when it is freed */
+#define TAG(id)     ((unsigned char)((id) * 31 + 7))
+
+static int check_tags(unsigned char *p, size_t size, int id)
+{
+    return size == 0 || (p[0] == TAG(id) && p[size - 1] == TAG(id));
+}
+
+/**********************************************************
+ * replay
+ * Run a trace once on a, on a fresh heap if it has an init.
+ * Per-op latencies go to lat and every op to hook, either
+ * may be NULL. util gets the peak live payload over the peak
+ * heap size, or -1 if the heap size is unknown. Return the
+ * elapsed seconds, or a negative value if the replay was
+ * invalid
+ **********************************************************/
+double replay(const allocator_t *a, const trace_t *t, uint64_t *lat,
+              replay_hook_t hook, void *arg, double *util)
+{
+    unsigned char **ptrs = calloc(t->num_ids, sizeof(*ptrs));
+    size_t *sizes = calloc(t->num_ids, sizeof(*sizes));
+    size_t live = 0, peak_live = 0, peak_heap = 0;
+    uint64_t t0 = 0;
+    double start, elapsed = -1;
+    int i;
+
+    if (ptrs == NULL || sizes == NULL) {
+        fprintf(stderr, "%s: out of memory\n", t->name);
+        goto out;
+    }
+    if (a->init != NULL && a->init() < 0) {
+        fprintf(stderr, "%s: init failed\n", a->name);
+        goto out;
+    }
+
+    start = now();
+    for (i = 0; i < t->num_ops; i++) {
+        const trace_op_t *op = &t->ops[i];
+        unsigned char *p = ptrs[op->id];
+        size_t old = sizes[op->id];
+
+        if (op->type != 'a' && !check_tags(p, old, op->id))
+            goto corrupt;
+        if (lat != NULL)
+            t0 = read_cycles();
+        if (op->type == 'a')
+            p = a->malloc_fn(op->size);
+        else if (op->type == 'r')
+            p = a->realloc_fn(p, op->size);
+        else
+            a->free_fn(p);
+        if (lat != NULL)
+            lat[i] = read_cycles() - t0;
+
+        if (op->type != 'f') {
+            if (p == NULL && op->size > 0) {
+                fprintf(stderr, "%s: %s op %d: out of memory\n", a->name, t->name, i);
+                goto out;
+            }
+            if ((uintptr_t)p % ALIGNMENT != 0) {
+                fprintf(stderr, "%s: %s op %d: misaligned payload %p\n", a->name, t->name, i, p);
+                goto out;
+            }
+            if (op->type == 'r' && old > 0 && op->size > 0 && p[0] != TAG(op->id))
+                goto corrupt;
+            if (op->size > 0) {
+                p[0] = TAG(op->id);
+                p[op->size - 1] = TAG(op->id);
+            }
+        } else {
+            p = NULL;
+        }
+        ptrs[op->id] = p;
+        sizes[op->id] = op->type == 'f' ? 0 : op->size;
+        live = live - old + sizes[op->id];
+
+        if (live > peak_live)
+            peak_live = live;
+        if (a->heap_size != NULL && a->heap_size() > peak_heap)
+            peak_heap = a->heap_size();
+        if (hook != NULL)
+            hook(arg, i, live);
+    }
+    elapsed = now() - start;
+    *util = peak_heap ? (double)peak_live / peak_heap : -1;
+    goto out;
+
+corrupt:
+    fprintf(stderr, "%s: %s op %d: payload of id %d was overwritten\n",
+            a->name, t->name, i, t->ops[i].id);
+out:
+    if (a->init == NULL && ptrs != NULL) {
+        for (i = 0; i < t->num_ids; i++)
+            a->free_fn(ptrs[i]);
+    }
+    free(ptrs);
+    free(sizes);
+    return elapsed;
+}
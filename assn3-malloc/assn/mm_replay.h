@@ -0,0 +1,66 @@
+/*
+ * mm_replay.h - .rep traces and their replay on an allocator, shared by
+ * mm_bench, mm_tune and mm_tracegen.
+ */
+#ifndef MM_REPLAY_H
+#define MM_REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef struct {
+    char type;                  /* 'a', 'r' or 'f' */
+    int id;
+    size_t size;
+} trace_op_t;
+
+typedef struct {
+    char name[64];
+    int num_ids;
+    int num_ops;
+    trace_op_t *ops;
+} trace_t;
+
+typedef struct {
+    const char *name;
+    int (*init)(void);          /* fresh heap, NULL if the allocator needs no reset */
+    void *(*malloc_fn)(size_t);
+    void *(*realloc_fn)(void *, size_t);
+    void (*free_fn)(void *);
+    size_t (*heap_size)(void);  /* NULL if unknown */
+} allocator_t;
+
+/* Called after op number op of a replay with the live payload bytes */
+typedef void (*replay_hook_t)(void *arg, int op, size_t live);
+
+/**********************************************************
+ * read_cycles
+ * Timestamp for per-op latencies: the TSC on x86, a monotonic
+ * clock in nanoseconds elsewhere
+ **********************************************************/
+static inline uint64_t read_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static inline double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int read_trace(const char *dir, const char *file, trace_t *t);
+double replay(const allocator_t *a, const trace_t *t, uint64_t *lat,
+              replay_hook_t hook, void *arg, double *util);
+
+#endif /* MM_REPLAY_H */
@@ -0,0 +1,142 @@
+/*
+ * mm_shim.c - the allocator as a drop-in malloc for unmodified programs.
+ *
+ * usage: LD_PRELOAD=./mm_shim.so app ...
+ *
+ * Exports the libc allocation functions on top of mm.c, built in
+ * concurrent mode (MM_THREADS) on the reserved-range backend of
+ * memlib_reserve.c, so the heap is real memory that can grow to
+ * MEM_RESERVE_SIZE.  The allocator is set up on the first call, which may
+ * come from libc itself before main.  Everything but these functions is
+ * hidden (-fvisibility=hidden), so mm.c cannot clash with the program's
+ * own symbols.  Where mm.c differs from the C library, the C library
+ * behaviour is kept: malloc(0) returns a unique pointer, failures set
+ * errno to ENOMEM and the alignment arguments are checked.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define SHIM_API    __attribute__((visibility("default")))
+
+static pthread_once_t shim_once = PTHREAD_ONCE_INIT;
+static int shim_ready;
+
+static void shim_init(void)
+{
+    mem_init();
+    if (mm_init() < 0)
+        abort();
+    __atomic_store_n(&shim_ready, 1, __ATOMIC_RELEASE);
+}
+
+static inline void shim_ensure(void)
+{
+    if (__builtin_expect(!__atomic_load_n(&shim_ready, __ATOMIC_ACQUIRE), 0))
+        pthread_once(&shim_once, shim_init);
+}
+
+static inline void *nomem(void *p)
+{
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+static inline int is_pow2(size_t x)
+{
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+SHIM_API void *malloc(size_t size)
+{
+    shim_ensure();
+    return nomem(mm_malloc(size ? size : 1));
+}
+
+SHIM_API void free(void *ptr)
+{
+    if (ptr != NULL)
+        mm_free(ptr);
+}
+
+SHIM_API void *calloc(size_t nmemb, size_t size)
+{
+    shim_ensure();
+    if (nmemb == 0 || size == 0)
+        nmemb = size = 1;
+    return nomem(mm_calloc(nmemb, size));
+}
+
+SHIM_API void *realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return malloc(size);
+    if (size == 0) {
+        mm_free(ptr);
+        return NULL;
+    }
+    return nomem(mm_realloc(ptr, size));
+}
+
+SHIM_API void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+SHIM_API int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (!is_pow2(align) || align % sizeof(void *) != 0)
+        return EINVAL;
+    shim_ensure();
+    if ((p = mm_memalign(align, size ? size : 1)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+SHIM_API void *aligned_alloc(size_t align, size_t size)
+{
+    if (!is_pow2(align)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    shim_ensure();
+    return nomem(mm_memalign(align, size ? size : 1));
+}
+
+SHIM_API void *memalign(size_t align, size_t size)
+{
+    /* Like glibc, round an alignment that is not a power of two up */
+    while (!is_pow2(align))
+        align = align ? (align | (align - 1)) + 1 : 1;
+    return aligned_alloc(align, size);
+}
+
+SHIM_API void *valloc(size_t size)
+{
+    return aligned_alloc(getpagesize(), size);
+}
+
+SHIM_API void *pvalloc(size_t size)
+{
+    size_t page = getpagesize();
+    return aligned_alloc(page, (size + page - 1) & ~(page - 1));
+}
+
+SHIM_API size_t malloc_usable_size(void *ptr)
+{
+    return mm_usable_size(ptr);
+}
@@ -0,0 +1,226 @@
+/*
+ * mm_stress.c - multi-threaded stress driver for the concurrent allocator.
+ *
+ * usage: mm_stress [-t maxthreads] [-n ops] [-s maxsize] [-x xfree%]
+ *
+ * Runs the same random malloc/free workload with 1, 2, 4, ... up to
+ * maxthreads threads against mm.c (built with -DMM_THREADS) and against
+ * the libc malloc, and reports throughput in Kops/sec for each.  Every
+ * thread owns a table of live blocks; a slot is allocated when empty and
+ * freed when full.  xfree percent of the frees are handed to the next
+ * thread instead, so that blocks are also freed by a thread other than
+ * the one that allocated them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define SLOTS       256     /* live blocks per thread */
+#define INBOX_SIZE  1024    /* blocks handed over to a thread, pending free */
+#define MAX_THREADS 64
+
+typedef struct {
+    void *(*malloc_fn)(size_t);
+    void (*free_fn)(void *);
+    const char *name;
+} allocator_t;
+
+typedef struct thread_ctx {
+    pthread_t tid;
+    unsigned seed;
+    const allocator_t *alloc;
+    struct thread_ctx *next;        /* receives our cross-thread frees */
+    pthread_mutex_t inbox_lock;
+    void *inbox[INBOX_SIZE];
+    unsigned inbox_count;
+} thread_ctx_t;
+
+static long ops_per_thread = 1000000;
+static size_t max_size = 1024;
+static unsigned xfree_pct = 10;
+
+static void *mm_malloc_fn(size_t size) { return mm_malloc(size); }
+static void mm_free_fn(void *ptr) { mm_free(ptr); }
+
+static const allocator_t allocators[] = {
+    { mm_malloc_fn, mm_free_fn, "mm" },
+    { malloc, free, "libc" },
+};
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Mostly small objects, with a tail of larger ones */
+static size_t random_size(unsigned *seed)
+{
+    unsigned r = rand_r(seed);
+    if (r % 8 != 0)
+        return 1 + (r >> 3) % 256;
+    return 1 + (r >> 3) % max_size;
+}
+
+static void drain_inbox(thread_ctx_t *ctx)
+{
+    void *batch[INBOX_SIZE];
+    unsigned i, n;
+
+    pthread_mutex_lock(&ctx->inbox_lock);
+    n = ctx->inbox_count;
+    memcpy(batch, ctx->inbox, n * sizeof(void *));
+    ctx->inbox_count = 0;
+    pthread_mutex_unlock(&ctx->inbox_lock);
+
+    for (i = 0; i < n; i++)
+        ctx->alloc->free_fn(batch[i]);
+}
+
+/* Hand a block to the next thread; free it ourselves if its inbox is full */
+static void hand_over(thread_ctx_t *ctx, void *ptr)
+{
+    thread_ctx_t *to = ctx->next;
+
+    pthread_mutex_lock(&to->inbox_lock);
+    if (to->inbox_count < INBOX_SIZE) {
+        to->inbox[to->inbox_count++] = ptr;
+        ptr = NULL;
+    }
+    pthread_mutex_unlock(&to->inbox_lock);
+    if (ptr != NULL)
+        ctx->alloc->free_fn(ptr);
+}
+
+static void *worker(void *arg)
+{
+    thread_ctx_t *ctx = arg;
+    void *slots[SLOTS] = { NULL };
+    long op;
+    unsigned i;
+
+    for (op = 0; op < ops_per_thread; op++) {
+        i = rand_r(&ctx->seed) % SLOTS;
+        if (slots[i] == NULL) {
+            size_t size = random_size(&ctx->seed);
+            if ((slots[i] = ctx->alloc->malloc_fn(size)) != NULL)
+                *(char *)slots[i] = (char)op;
+        } else if (rand_r(&ctx->seed) % 100 < xfree_pct) {
+            hand_over(ctx, slots[i]);
+            slots[i] = NULL;
+        } else {
+            ctx->alloc->free_fn(slots[i]);
+            slots[i] = NULL;
+        }
+        if ((op & 255) == 0)
+            drain_inbox(ctx);
+    }
+
+    for (i = 0; i < SLOTS; i++)
+        if (slots[i] != NULL)
+            ctx->alloc->free_fn(slots[i]);
+    return NULL;
+}
+
+/* Run the workload on nthreads threads, return Kops/sec */
+static double run(const allocator_t *alloc, int nthreads)
+{
+    thread_ctx_t ctx[MAX_THREADS];
+    double start, elapsed;
+    int i;
+
+    if (alloc->malloc_fn == mm_malloc_fn) {
+        mem_reset_brk();
+        if (mm_init() < 0) {
+            fprintf(stderr, "mm_init failed\n");
+            exit(1);
+        }
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        ctx[i].seed = 12345 + i;
+        ctx[i].alloc = alloc;
+        ctx[i].next = &ctx[(i + 1) % nthreads];
+        ctx[i].inbox_count = 0;
+        pthread_mutex_init(&ctx[i].inbox_lock, NULL);
+    }
+
+    start = now();
+    for (i = 0; i < nthreads; i++)
+        pthread_create(&ctx[i].tid, NULL, worker, &ctx[i]);
+    for (i = 0; i < nthreads; i++)
+        pthread_join(ctx[i].tid, NULL);
+    elapsed = now() - start;
+
+    /* Blocks still waiting in inboxes */
+    for (i = 0; i < nthreads; i++) {
+        drain_inbox(&ctx[i]);
+        pthread_mutex_destroy(&ctx[i].inbox_lock);
+    }
+
+    return nthreads * ops_per_thread / elapsed / 1000.0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t maxthreads] [-n ops] [-s maxsize] [-x xfree%%]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    double base[2] = { 0, 0 };
+    int c, t;
+
+    while ((c = getopt(argc, argv, "t:n:s:x:h")) != -1) {
+        switch (c) {
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'n':
+            ops_per_thread = atol(optarg);
+            break;
+        case 's':
+            max_size = atol(optarg);
+            break;
+        case 'x':
+            xfree_pct = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (max_threads < 1)
+        max_threads = 1;
+    if (max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+
+    mem_init();
+
+    printf("%d ops/thread, sizes 1..%zu, %u%% cross-thread frees\n",
+           (int)ops_per_thread, max_size, xfree_pct);
+    printf("%8s %12s %8s %12s %8s\n", "threads", "mm Kops/s", "scale", "libc Kops/s", "scale");
+    for (t = 1; t <= max_threads; t = (t * 2 > max_threads && t != max_threads) ? max_threads : t * 2) {
+        double r[2];
+        int a;
+        for (a = 0; a < 2; a++) {
+            r[a] = run(&allocators[a], t);
+            if (t == 1)
+                base[a] = r[a];
+        }
+        printf("%8d %12.0f %8.2f %12.0f %8.2f\n",
+               t, r[0], r[0] / base[0], r[1], r[1] / base[1]);
+    }
+
+    mem_deinit();
+    return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * mm_trace.c - lock-free trace ring buffer and its flusher.
+ *
+ * The ring is a bounded multi-producer queue in the style of Vyukov:
+ * every slot carries a sequence number, a producer claims a position with
+ * a CAS on head and publishes the record by bumping the slot sequence.
+ * A full ring never blocks the allocator; the record is dropped and
+ * counted instead.  Only the flusher (the background thread, an explicit
+ * mm_trace_flush() or the atexit hook) does I/O.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mm_trace.h"
+
+static const char *const op_names[MM_EV_OP_COUNT] = {
+    [MM_EV_MALLOC]   = "malloc",
+    [MM_EV_FREE]     = "free",
+    [MM_EV_REALLOC]  = "realloc",
+    [MM_EV_INSERT]   = "insert",
+    [MM_EV_REMOVE]   = "remove",
+    [MM_EV_FIT]      = "fit",
+    [MM_EV_SPLIT]    = "split",
+    [MM_EV_COALESCE] = "coalesce",
+    [MM_EV_EXTEND]   = "extend",
+    [MM_EV_RUN_NEW]  = "run_new",
+    [MM_EV_RUN_RELEASE] = "run_free",
+    [MM_EV_MMAP]     = "mmap",
+    [MM_EV_MUNMAP]   = "munmap",
+    [MM_EV_TRIM]     = "trim",
+};
+
+/**********************************************************
+ * mm_trace_op_name
+ * Return a printable name for an event code
+ **********************************************************/
+const char *mm_trace_op_name(unsigned op)
+{
+    if (op < MM_EV_OP_COUNT && op_names[op] != NULL)
+        return op_names[op];
+    return "unknown";
+}
+
+#ifdef MM_TRACE
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+/* The ring holds 2**MM_TRACE_RING_ORDER records */
+#ifndef MM_TRACE_RING_ORDER
+#define MM_TRACE_RING_ORDER 18
+#endif
+#define RING_SIZE   ((uint64_t)1 << MM_TRACE_RING_ORDER)
+#define RING_MASK   (RING_SIZE - 1)
+
+/* Records copied out of the ring per write(2) */
+#define FLUSH_BATCH 1024
+/* Background flusher wake-up period */
+#define FLUSH_PERIOD_NS 1000000L
+
+typedef struct {
+    uint64_t seq;
+    mm_trace_rec_t rec;
+} trace_slot_t;
+
+static trace_slot_t ring[RING_SIZE];
+static uint64_t ring_head;              /* next position producers claim */
+static uint64_t ring_tail;              /* next position to drain, under flush_lock */
+static uint64_t ring_dropped;
+
+static int trace_ready;
+static int trace_fd = -1;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**********************************************************
+ * read_cycles
+ * Cheap timestamp for a record: the TSC on x86, a monotonic
+ * clock in nanoseconds elsewhere
+ **********************************************************/
+static inline uint64_t read_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static void write_all(const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0 && trace_fd >= 0) {
+        ssize_t n = write(trace_fd, p, len);
+        if (n <= 0)
+            return;
+        p += n;
+        len -= n;
+    }
+}
+
+/**********************************************************
+ * mm_trace_flush
+ * Drain every published record from the ring into the dump
+ * file.  Safe to call from any thread; never called by the
+ * allocator itself
+ **********************************************************/
+void mm_trace_flush(void)
+{
+    mm_trace_rec_t batch[FLUSH_BATCH];
+    size_t n = 0;
+
+    if (!__atomic_load_n(&trace_ready, __ATOMIC_ACQUIRE))
+        return;
+
+    pthread_mutex_lock(&flush_lock);
+    for (;;) {
+        trace_slot_t *slot = &ring[ring_tail & RING_MASK];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq != ring_tail + 1)
+            break;
+        batch[n++] = slot->rec;
+        /* Hand the slot back to producers for the next lap */
+        __atomic_store_n(&slot->seq, ring_tail + RING_SIZE, __ATOMIC_RELEASE);
+        ring_tail++;
+        if (n == FLUSH_BATCH) {
+            write_all(batch, sizeof(batch));
+            n = 0;
+        }
+    }
+    if (n > 0)
+        write_all(batch, n * sizeof(mm_trace_rec_t));
+    pthread_mutex_unlock(&flush_lock);
+}
+
+uint64_t mm_trace_dropped(void)
+{
+    return __atomic_load_n(&ring_dropped, __ATOMIC_RELAXED);
+}
+
+static void *flusher_main(void *arg)
+{
+    struct timespec period = { 0, FLUSH_PERIOD_NS };
+    (void)arg;
+    for (;;) {
+        nanosleep(&period, NULL);
+        mm_trace_flush();
+    }
+    return NULL;
+}
+
+static void trace_atexit(void)
+{
+    mm_trace_flush();
+    if (ring_dropped > 0)
+        fprintf(stderr, "mm_trace: ring full, dropped %llu records\n",
+                (unsigned long long)ring_dropped);
+}
+
+/**********************************************************
+ * trace_init
+ * One-time setup on the first event: seed slot sequence
+ * numbers, open the dump file and start the flusher
+ **********************************************************/
+static void trace_init(void)
+{
+    const char *path = getenv("MM_TRACE_FILE");
+    mm_trace_hdr_t hdr;
+    pthread_t tid;
+    uint64_t i;
+
+    for (i = 0; i < RING_SIZE; i++)
+        ring[i].seq = i;
+
+    trace_fd = open(path ? path : "mm_trace.bin",
+                    O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MM_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.rec_size = sizeof(mm_trace_rec_t);
+    write_all(&hdr, sizeof(hdr));
+
+    __atomic_store_n(&trace_ready, 1, __ATOMIC_RELEASE);
+    atexit(trace_atexit);
+    if (pthread_create(&tid, NULL, flusher_main, NULL) == 0)
+        pthread_detach(tid);
+}
+
+/**********************************************************
+ * mm_trace_emit
+ * Claim a ring slot and publish one record.  Lock-free; drops
+ * the record if the flusher has fallen a full ring behind
+ **********************************************************/
+void mm_trace_emit(unsigned op, uint64_t size, uint32_t bin, const void *addr)
+{
+    trace_slot_t *slot;
+    uint64_t pos;
+
+    if (__builtin_expect(!__atomic_load_n(&trace_ready, __ATOMIC_ACQUIRE), 0))
+        pthread_once(&trace_once, trace_init);
+
+    pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &ring[pos & RING_MASK];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring_head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            __atomic_fetch_add(&ring_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->rec.cycles = read_cycles();
+    slot->rec.addr = (uint64_t)(uintptr_t)addr;
+    slot->rec.size = size;
+    slot->rec.bin = bin;
+    slot->rec.op = (uint16_t)op;
+    slot->rec.reserved = 0;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* MM_TRACE */
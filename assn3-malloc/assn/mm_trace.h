@@ -0,0 +1,77 @@
+/*
+ * mm_trace.h - compile-time removable event tracing for the allocator.
+ *
+ * When MM_TRACE is not defined (the default build) every MM_TRACE_EVENT()
+ * expands to nothing and its arguments are never evaluated, so release
+ * builds pay nothing for the trace points left in mm.c.
+ *
+ * When built with -DMM_TRACE (make TRACE=1), each event is packed into a
+ * fixed-size binary record and pushed onto a lock-free ring buffer.
+ * Producers never touch stdio: a background flusher thread (and an atexit
+ * hook for the tail) drains the ring to the dump file named by the
+ * MM_TRACE_FILE environment variable, "mm_trace.bin" by default.
+ * mm_tracedump decodes the dump back into readable text.
+ */
+#ifndef MM_TRACE_H
+#define MM_TRACE_H
+
+#include <stdint.h>
+
+/* Event codes stored in mm_trace_rec_t.op */
+enum mm_trace_op {
+    MM_EV_MALLOC = 1,   /* size = asize, addr = returned block */
+    MM_EV_FREE,         /* size = block size, addr = freed block */
+    MM_EV_REALLOC,      /* size = requested bytes, addr = old block */
+    MM_EV_INSERT,       /* free block inserted into bin */
+    MM_EV_REMOVE,       /* free block removed from bin */
+    MM_EV_FIT,          /* find_fit hit, size = block size */
+    MM_EV_SPLIT,        /* size = asize kept, addr = split block */
+    MM_EV_COALESCE,     /* bin = coalesce case (1-4), size = merged size */
+    MM_EV_EXTEND,       /* size = bytes obtained from mem_sbrk */
+    MM_EV_RUN_NEW,      /* slab run carved, bin = size class */
+    MM_EV_RUN_RELEASE,  /* empty slab run returned, bin = size class */
+    MM_EV_MMAP,         /* huge block mapped or remapped, size = mapping length */
+    MM_EV_MUNMAP,       /* huge block unmapped, size = mapping length */
+    MM_EV_TRIM,         /* pages of a free block released, size = bytes */
+    MM_EV_OP_COUNT
+};
+
+/* Value stored in the bin field when an event has no bin */
+#define MM_TRACE_NO_BIN 0xffffffffu
+
+/* One binary trace record; 32 bytes, written as-is to the dump file */
+typedef struct {
+    uint64_t cycles;    /* cycle counter when the event was recorded */
+    uint64_t addr;      /* block pointer the event refers to */
+    uint64_t size;      /* size in bytes, meaning depends on op */
+    uint32_t bin;       /* free list bin, or op specific argument */
+    uint16_t op;        /* enum mm_trace_op */
+    uint16_t reserved;
+} mm_trace_rec_t;
+
+/* Dump file header, followed by a stream of mm_trace_rec_t */
+#define MM_TRACE_MAGIC   "MMTRACE1"
+typedef struct {
+    char magic[8];
+    uint32_t rec_size;  /* sizeof(mm_trace_rec_t) of the writer */
+    uint32_t reserved;
+} mm_trace_hdr_t;
+
+const char *mm_trace_op_name(unsigned op);
+
+#ifdef MM_TRACE
+
+void mm_trace_emit(unsigned op, uint64_t size, uint32_t bin, const void *addr);
+void mm_trace_flush(void);
+uint64_t mm_trace_dropped(void);
+
+#define MM_TRACE_EVENT(op, size, bin, addr) \
+    mm_trace_emit((op), (uint64_t)(size), (uint32_t)(bin), (addr))
+
+#else
+
+#define MM_TRACE_EVENT(op, size, bin, addr) ((void)0)
+
+#endif /* MM_TRACE */
+
+#endif /* MM_TRACE_H */
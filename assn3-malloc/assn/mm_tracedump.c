@@ -0,0 +1,96 @@
+/*
+ * mm_tracedump.c - decode a binary allocator trace into readable text.
+ *
+ * usage: mm_tracedump [-s] [dumpfile]
+ *
+ * Prints one line per record with the cycle count relative to the first
+ * record.  With -s only a per-event summary is printed.  Reads
+ * mm_trace.bin when no file is given.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "mm_trace.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-s] [dumpfile]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = "mm_trace.bin";
+    int summary = 0;
+    int c;
+    FILE *fp;
+    mm_trace_hdr_t hdr;
+    mm_trace_rec_t rec;
+    uint64_t first = 0, total = 0;
+    uint64_t counts[MM_EV_OP_COUNT] = { 0 };
+    uint64_t bytes[MM_EV_OP_COUNT] = { 0 };
+
+    while ((c = getopt(argc, argv, "sh")) != -1) {
+        switch (c) {
+        case 's':
+            summary = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        perror(path);
+        return 1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, MM_TRACE_MAGIC, sizeof(hdr.magic)) != 0) {
+        fprintf(stderr, "%s: not an mm trace dump\n", path);
+        return 1;
+    }
+    if (hdr.rec_size != sizeof(rec)) {
+        fprintf(stderr, "%s: record size %u, expected %zu\n",
+                path, hdr.rec_size, sizeof(rec));
+        return 1;
+    }
+
+    while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+        if (total++ == 0)
+            first = rec.cycles;
+        if (rec.op < MM_EV_OP_COUNT) {
+            counts[rec.op]++;
+            bytes[rec.op] += rec.size;
+        }
+        if (summary)
+            continue;
+        printf("%12llu %-8s size=%-8llu",
+               (unsigned long long)(rec.cycles - first),
+               mm_trace_op_name(rec.op), (unsigned long long)rec.size);
+        if (rec.bin != MM_TRACE_NO_BIN) {
+            if (rec.op == MM_EV_COALESCE)
+                printf(" case=%-3u", rec.bin);
+            else
+                printf(" bin=%-4u", rec.bin);
+        } else {
+            printf("         ");
+        }
+        printf(" %#llx\n", (unsigned long long)rec.addr);
+    }
+    fclose(fp);
+
+    if (summary) {
+        unsigned op;
+        printf("%-10s %12s %16s\n", "event", "count", "bytes");
+        for (op = 1; op < MM_EV_OP_COUNT; op++)
+            printf("%-10s %12llu %16llu\n", mm_trace_op_name(op),
+                   (unsigned long long)counts[op], (unsigned long long)bytes[op]);
+        printf("%-10s %12llu\n", "total", (unsigned long long)total);
+    }
+    return 0;
+}
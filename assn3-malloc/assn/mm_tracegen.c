@@ -0,0 +1,356 @@
+/*
+ * mm_tracegen.c - synthetic .rep traces fitted to a recorded one.
+ *
+ * usage: mm_tracegen [-n ops] [-l scale] [-s seed] [-o out.rep] trace.rep
+ *
+ * Reads a trace (recorded with mm_record.so, or any .rep file) and fits
+ * its workload: the empirical distribution of request sizes, the lifetime
+ * of a block in ops for each power-of-two size class, the number of
+ * reallocs a block sees and the ratio of new to old size of each realloc.
+ * Then it emits a balanced trace of about ops operations (1000000 by
+ * default) drawn from these distributions to out.rep, or stdout.  -l
+ * multiplies lifetimes, which scales the live heap by the same factor.
+ * A summary of the fit and of the generated trace goes to stderr.
+ * Ids skip those with a low byte of 128-255, as mm_record.so does, so that
+ * mdriver accepts the reallocs of the trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "mm_replay.h"
+
+#define SIZE_CLASSES    48      /* power-of-two classes of request sizes */
+
+/* The id after id: mdriver compares the payload byte of an id with a low
+ * byte of 128-255 as a signed char after a realloc, and fails it */
+#define NEXT_ID(id)     ((((id) + 1) & 0xFF) == 128 ? (id) + 129 : (id) + 1)
+
+/* Growable array of samples */
+typedef struct {
+    size_t n, cap;
+    double *v;
+} samples_t;
+
+/* Future op of a generated block, ordered by time in the event heap */
+typedef struct {
+    uint64_t time;
+    uint32_t id;
+    char type;
+    size_t size;
+} event_t;
+
+typedef struct {
+    samples_t sizes;                    /* requested size of every malloc */
+    samples_t lifetimes[SIZE_CLASSES];  /* ops from malloc to free, per class */
+    samples_t all_lifetimes;
+    samples_t reallocs;                 /* reallocs seen by each block */
+    samples_t ratios;                   /* new size / old size of each realloc */
+    size_t max_size;
+} model_t;
+
+static void push(samples_t *s, double v)
+{
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 64;
+        s->v = realloc(s->v, s->cap * sizeof(double));
+        if (s->v == NULL) {
+            fprintf(stderr, "mm_tracegen: out of memory\n");
+            exit(1);
+        }
+    }
+    s->v[s->n++] = v;
+}
+
+static double mean(const samples_t *s)
+{
+    double sum = 0;
+    size_t i;
+
+    for (i = 0; i < s->n; i++)
+        sum += s->v[i];
+    return s->n ? sum / s->n : 0;
+}
+
+static inline int size_class(size_t size)
+{
+    int c = 0;
+
+    while (size > 1 && c < SIZE_CLASSES - 1) {
+        size >>= 1;
+        c++;
+    }
+    return c;
+}
+
+/* Draw from an empirical distribution */
+static inline double draw(const samples_t *s)
+{
+    return s->v[(size_t)(drand48() * s->n)];
+}
+
+/**********************************************************
+ * fit
+ * Collect the samples of the model from a trace. Blocks that
+ * are never freed live until the end of the trace
+ **********************************************************/
+static void fit(const trace_op_t *ops, int num_ids, int num_ops, model_t *m)
+{
+    int *birth = malloc(num_ids * sizeof(int));
+    int *nreallocs = calloc(num_ids, sizeof(int));
+    int *sclass = malloc(num_ids * sizeof(int));
+    size_t *cur = calloc(num_ids, sizeof(size_t));
+    int i;
+
+    memset(m, 0, sizeof(*m));
+    for (i = 0; i < num_ids; i++)
+        birth[i] = -1;
+
+    for (i = 0; i < num_ops; i++) {
+        const trace_op_t *op = &ops[i];
+        double life;
+
+        switch (op->type) {
+        case 'a':
+            birth[op->id] = i;
+            sclass[op->id] = size_class(op->size);
+            cur[op->id] = op->size;
+            push(&m->sizes, op->size);
+            break;
+        case 'r':
+            if (birth[op->id] < 0)
+                break;
+            if (cur[op->id] > 0 && op->size > 0)
+                push(&m->ratios, (double)op->size / cur[op->id]);
+            cur[op->id] = op->size;
+            nreallocs[op->id]++;
+            break;
+        default:
+            if (birth[op->id] < 0)
+                break;
+            life = i - birth[op->id];
+            push(&m->lifetimes[sclass[op->id]], life);
+            push(&m->all_lifetimes, life);
+            push(&m->reallocs, nreallocs[op->id]);
+            birth[op->id] = -1;
+            break;
+        }
+        if (op->size > m->max_size)
+            m->max_size = op->size;
+    }
+    for (i = 0; i < num_ids; i++) {
+        if (birth[i] >= 0) {
+            push(&m->lifetimes[sclass[i]], num_ops - birth[i]);
+            push(&m->all_lifetimes, num_ops - birth[i]);
+            push(&m->reallocs, nreallocs[i]);
+        }
+    }
+    free(birth);
+    free(nreallocs);
+    free(sclass);
+    free(cur);
+}
+
+/**********************************************************
+ * heap_push, heap_pop
+ * Binary min-heap of pending events by time
+ **********************************************************/
+static void heap_push(event_t **heap, size_t *n, size_t *cap, event_t ev)
+{
+    size_t i;
+
+    if (*n == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        *heap = realloc(*heap, *cap * sizeof(event_t));
+        if (*heap == NULL) {
+            fprintf(stderr, "mm_tracegen: out of memory\n");
+            exit(1);
+        }
+    }
+    for (i = (*n)++; i > 0 && (*heap)[(i - 1) / 2].time > ev.time; i = (i - 1) / 2)
+        (*heap)[i] = (*heap)[(i - 1) / 2];
+    (*heap)[i] = ev;
+}
+
+static event_t heap_pop(event_t *heap, size_t *n)
+{
+    event_t top = heap[0], last = heap[--*n];
+    size_t i = 0, c;
+
+    while ((c = 2 * i + 1) < *n) {
+        if (c + 1 < *n && heap[c + 1].time < heap[c].time)
+            c++;
+        if (heap[c].time >= last.time)
+            break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    if (*n > 0)
+        heap[i] = last;
+    return top;
+}
+
+/**********************************************************
+ * generate
+ * Emit about target ops: a malloc whenever no earlier event
+ * is due, with its reallocs spread over its drawn lifetime
+ * and its free at the end of it. Once the pending events
+ * would reach target, no more blocks are started and the
+ * pending events are drained in time order
+ **********************************************************/
+static trace_op_t *generate(const model_t *m, size_t target, double scale,
+                            size_t *num_ids, size_t *num_ops, size_t *peak)
+{
+    trace_op_t *out = malloc((target + 1) * sizeof(trace_op_t));
+    size_t *sizes = NULL, sizes_cap = 0;
+    event_t *heap = NULL, ev;
+    size_t n = 0, cap = 0, ops = 0, ids = 0, live = 0;
+
+    *peak = 0;
+    while (out != NULL && ops < target) {
+        if (n > 0 && (heap[0].time <= ops || ops + n >= target)) {
+            ev = heap_pop(heap, &n);
+            out[ops].type = ev.type;
+            out[ops].id = ev.id;
+            out[ops].size = ev.size;
+            live += ev.size - sizes[ev.id];
+            sizes[ev.id] = ev.size;
+        } else if (ops + n + 2 <= target) {
+            size_t size = draw(&m->sizes);
+            int c = size_class(size);
+            const samples_t *lt = m->lifetimes[c].n ? &m->lifetimes[c] : &m->all_lifetimes;
+            size_t k = m->ratios.n ? draw(&m->reallocs) : 0;
+            uint64_t life = draw(lt) * scale, j;
+
+            if (ops + n + k + 2 > target)
+                k = 0;
+            if (life < k + 1)
+                life = k + 1;
+            if (ids >= sizes_cap) {
+                sizes_cap = sizes_cap ? sizes_cap * 2 : 1024;
+                if ((sizes = realloc(sizes, sizes_cap * sizeof(size_t))) == NULL)
+                    break;
+            }
+            out[ops].type = 'a';
+            out[ops].id = ids;
+            out[ops].size = size;
+            sizes[ids] = size;
+            live += size;
+
+            ev.id = ids;
+            for (j = 1; j <= k; j++) {
+                double next = size * draw(&m->ratios);
+                size = next < 1 ? 1 : next > m->max_size ? m->max_size : next;
+                ev.time = ops + life * j / (k + 1);
+                ev.type = 'r';
+                ev.size = size;
+                heap_push(&heap, &n, &cap, ev);
+            }
+            ev.time = ops + life;
+            ev.type = 'f';
+            ev.size = 0;
+            heap_push(&heap, &n, &cap, ev);
+            ids = NEXT_ID(ids);
+        } else {
+            break;
+        }
+        if (live > *peak)
+            *peak = live;
+        ops++;
+    }
+    /* Drain the events left when no block of two ops fit any more */
+    while (out != NULL && n > 0) {
+        ev = heap_pop(heap, &n);
+        out[ops].type = ev.type;
+        out[ops].id = ev.id;
+        out[ops].size = ev.size;
+        ops++;
+    }
+    free(heap);
+    free(sizes);
+    *num_ids = ids;
+    *num_ops = ops;
+    return out;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n ops] [-l scale] [-s seed] [-o out.rep] trace.rep\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    size_t target = 1000000, num_ids, num_ops, peak, i;
+    double scale = 1.0;
+    long seed = 1;
+    const char *out_path = NULL;
+    int c, cls;
+    trace_op_t *out;
+    trace_t in;
+    model_t m;
+    FILE *fp = stdout;
+
+    while ((c = getopt(argc, argv, "n:l:s:o:h")) != -1) {
+        switch (c) {
+        case 'n':
+            target = strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            scale = atof(optarg);
+            break;
+        case 's':
+            seed = atol(optarg);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || target < 2 || target > INT_MAX || scale <= 0)
+        usage(argv[0]);
+    if (!read_trace(NULL, argv[optind], &in))
+        return 1;
+
+    fit(in.ops, in.num_ids, in.num_ops, &m);
+    free(in.ops);
+    if (m.sizes.n == 0) {
+        fprintf(stderr, "%s: no mallocs to fit\n", argv[optind]);
+        return 1;
+    }
+    fprintf(stderr, "fit of %s: %d ops, %zu mallocs, mean size %.0f, max size %zu\n",
+            argv[optind], in.num_ops, m.sizes.n, mean(&m.sizes), m.max_size);
+    fprintf(stderr, "  mean lifetime %.0f ops, %.2f reallocs per block, mean realloc ratio %.2f\n",
+            mean(&m.all_lifetimes), mean(&m.reallocs), mean(&m.ratios));
+    for (cls = 0; cls < SIZE_CLASSES; cls++) {
+        if (m.lifetimes[cls].n > 0)
+            fprintf(stderr, "  sizes < 2^%-2d %9zu blocks, mean lifetime %.0f ops\n",
+                    cls + 1, m.lifetimes[cls].n, mean(&m.lifetimes[cls]));
+    }
+
+    srand48(seed);
+    if ((out = generate(&m, target, scale, &num_ids, &num_ops, &peak)) == NULL) {
+        fprintf(stderr, "mm_tracegen: out of memory\n");
+        return 1;
+    }
+    if (out_path != NULL && (fp = fopen(out_path, "w")) == NULL) {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(fp, "%zu\n%zu\n%zu\n1\n", peak < INT_MAX ? peak : INT_MAX, num_ids, num_ops);
+    for (i = 0; i < num_ops; i++) {
+        if (out[i].type == 'f')
+            fprintf(fp, "f %d\n", out[i].id);
+        else
+            fprintf(fp, "%c %d %zu\n", out[i].type, out[i].id, out[i].size);
+    }
+    if (fp != stdout)
+        fclose(fp);
+    fprintf(stderr, "generated %zu ops on %zu ids, peak live %zu bytes\n", num_ops, num_ids, peak);
+    return 0;
+}
@@ -0,0 +1,377 @@
+/*
+ * mm_tune.c - search the tuning parameters of mm.c on a trace corpus.
+ *
+ * usage: mm_tune [-t tracedir] [-f tracefile]... [-n reps] [-w weight]
+ *                [-k kops] [-i passes] [-g pct] [-o header]
+ *
+ * Replays every .rep trace in tracedir (../traces by default), or only the
+ * -f files, e.g. traces recorded with mm_record.so, under one set of
+ * mm_params_t at a time, and scores the set as
+ *
+ *     weight * utilization + (1 - weight) * throughput
+ *
+ * Utilization is the mean over the traces of peak live payload / peak heap
+ * size. Throughput is the ops per second over all traces relative to a
+ * reference, capped at 1 as mdriver does: by default the libc malloc on the
+ * same traces, as mdriver compares against libc, or -k kops. Once a set is
+ * as fast as the reference only its utilization counts, so timer noise
+ * cannot buy a utilization loss. The weight is 0.6 by default, the share
+ * of utilization in the mdriver score.
+ *
+ * The search is coordinate descent over a grid of values per parameter:
+ * starting from the built-in set, each parameter in turn takes the value
+ * that scores best with the others fixed, until a pass changes nothing or
+ * -i passes (4 by default) are done. A set is timed as the fastest of -n
+ * replays of each trace (10 by default). A change has to gain more than
+ * -g pct percent of score (1 by default), and keep that gain when the
+ * incumbent and the candidate are both timed again, CONFIRM_ROUNDS times in
+ * turn, so that one lucky run does not steer the search. A change that
+ * lowers utilization is never taken: mdriver caps its throughput mark well
+ * below either allocator, so there it only costs score.
+ *
+ * The best set is written as a header of compile-time defaults for mm.c,
+ * mm_tuned.h unless -o says otherwise; "make TUNED=mm_tuned.h" builds with
+ * it. Traces larger than memlib's heap need "make MEMLIB=reserve mm_tune".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "mm_replay.h"
+
+#define MAX_TRACES      64
+#define MAX_VALUES      8
+#define CONFIRM_ROUNDS  2
+
+/* The searched parameters, in the order they are tuned */
+enum {
+    P_SPLIT_MIN, P_FIT_SLACK, P_REALLOC_HEADROOM,
+    P_GROW_MIN, P_GROW_MAX, P_GROW_SHIFT, P_TRIM, P_COUNT
+};
+
+/* Candidate values of each parameter, named after its knob in mm.c */
+static const struct {
+    const char *knob;
+    int count;
+    size_t values[MAX_VALUES];
+} grid[P_COUNT] = {
+    { "SPLIT_MIN_SIZE",   6, { 32, 48, 64, 96, 128, 256 } },
+    { "FIT_SLACK",        6, { 0, 32, 64, 128, 256, 512 } },
+    { "REALLOC_HEADROOM", 7, { 0, 12, 25, 50, 75, 100, 200 } },
+    { "GROW_MIN_SIZE",    6, { 512, 1024, 2048, 4096, 8192, 16384 } },
+    { "GROW_MAX_SIZE",    6, { 0, 16384, 65536, 262144, 1048576, 4194304 } },
+    { "GROW_HEAP_SHIFT",  6, { 3, 4, 5, 6, 7, 9 } },
+    { "TRIM_THRESHOLD",   4, { 0, 262144, 2097152, 16777216 } },
+};
+
+static trace_t traces[MAX_TRACES];
+static int ntraces;
+
+static int cmp_name(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**********************************************************
+ * read_dir
+ * Read every .rep file of dir, in name order
+ **********************************************************/
+static void read_dir(const char *dir)
+{
+    char *names[MAX_TRACES];
+    struct dirent *de;
+    DIR *d;
+    int n = 0, i;
+
+    if ((d = opendir(dir)) == NULL) {
+        perror(dir);
+        return;
+    }
+    while ((de = readdir(d)) != NULL && n < MAX_TRACES) {
+        size_t len = strlen(de->d_name);
+        if (len > 4 && strcmp(de->d_name + len - 4, ".rep") == 0)
+            names[n++] = strdup(de->d_name);
+    }
+    closedir(d);
+    qsort(names, n, sizeof(names[0]), cmp_name);
+    for (i = 0; i < n; i++) {
+        if (read_trace(dir, names[i], &traces[ntraces]))
+            ntraces++;
+        free(names[i]);
+    }
+}
+
+static int mm_reset(void)
+{
+    mem_reset_brk();
+    return mm_init();
+}
+
+static const allocator_t mm_allocator = {
+    "mm", mm_reset, mm_malloc, mm_realloc, mm_free, mem_heapsize
+};
+static const allocator_t libc_allocator = {
+    "libc", NULL, malloc, realloc, free, NULL
+};
+
+static void get_values(const mm_params_t *p, size_t *v)
+{
+    v[P_SPLIT_MIN] = p->split_min;
+    v[P_FIT_SLACK] = p->fit_slack;
+    v[P_REALLOC_HEADROOM] = p->realloc_headroom;
+    v[P_GROW_MIN] = p->grow_min;
+    v[P_GROW_MAX] = p->grow_max;
+    v[P_GROW_SHIFT] = p->grow_shift;
+    v[P_TRIM] = p->trim_threshold;
+}
+
+static void set_values(mm_params_t *p, const size_t *v)
+{
+    p->split_min = v[P_SPLIT_MIN];
+    p->fit_slack = v[P_FIT_SLACK];
+    p->realloc_headroom = v[P_REALLOC_HEADROOM];
+    p->grow_min = v[P_GROW_MIN];
+    p->grow_max = v[P_GROW_MAX];
+    p->grow_shift = v[P_GROW_SHIFT];
+    p->trim_threshold = v[P_TRIM];
+}
+
+/**********************************************************
+ * run_all
+ * Mean peak utilization and throughput of allocator a over
+ * all traces, each timed as the fastest of reps runs. Return
+ * 0 if a replay fails
+ **********************************************************/
+static int run_all(const allocator_t *a, int reps, double *util, double *kops)
+{
+    double secs = 0, util_sum = 0;
+    long ops = 0;
+    int i, r;
+
+    for (i = 0; i < ntraces; i++) {
+        double best = -1, s, u = 0;
+        for (r = 0; r < reps; r++) {
+            if ((s = replay(a, &traces[i], NULL, NULL, NULL, &u)) < 0)
+                return 0;
+            if (best < 0 || s < best)
+                best = s;
+        }
+        secs += best;
+        util_sum += u;
+        ops += traces[i].num_ops;
+    }
+    *util = util_sum / ntraces;
+    *kops = secs > 0 ? ops / secs / 1000.0 : 0;
+    return 1;
+}
+
+/**********************************************************
+ * evaluate
+ * run_all on mm.c with the parameter set v. Return 0 if
+ * mm_set_params rejects the set or a replay fails
+ **********************************************************/
+static int evaluate(const size_t *v, int reps, double *util, double *kops)
+{
+    mm_params_t p;
+
+    set_values(&p, v);
+    if (mm_set_params(&p) < 0)
+        return 0;
+    return run_all(&mm_allocator, reps, util, kops);
+}
+
+/* Throughput over ref_kops, capped at 1 like the mdriver score */
+static double score(double util, double kops, double weight, double ref_kops)
+{
+    double thru = kops / ref_kops;
+
+    if (thru > 1)
+        thru = 1;
+    return weight * util + (1 - weight) * thru;
+}
+
+/**********************************************************
+ * confirm
+ * Time the incumbent set best and the candidate v again, in
+ * turn, CONFIRM_ROUNDS times. Return 1 if the candidate
+ * beats the incumbent by min_gain percent every round,
+ * setting its utilization, throughput and score of the
+ * last round
+ **********************************************************/
+static int confirm(const size_t *best, const size_t *v, int reps, double weight,
+                   double ref_kops, double min_gain, double *util, double *kops, double *s)
+{
+    double bu, bk;
+    int round;
+
+    for (round = 0; round < CONFIRM_ROUNDS; round++) {
+        if (!evaluate(best, reps, &bu, &bk) || !evaluate(v, reps, util, kops))
+            return 0;
+        *s = score(*util, *kops, weight, ref_kops);
+        if (*s <= score(bu, bk, weight, ref_kops) * (1 + min_gain / 100))
+            return 0;
+    }
+    return 1;
+}
+
+static void print_values(FILE *fp, const char *prefix, const size_t *v)
+{
+    int i;
+
+    for (i = 0; i < P_COUNT; i++)
+        fprintf(fp, "%s%-20s %zu\n", prefix, grid[i].knob, v[i]);
+}
+
+/**********************************************************
+ * write_header
+ * Write the parameter set as compile-time defaults of mm.c
+ **********************************************************/
+static int write_header(const char *path, const size_t *v, double util, double kops,
+                        double s, double weight)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL) {
+        perror(path);
+        return 0;
+    }
+    fprintf(fp, "/* %s - generated by mm_tune on %d traces: mean utilization %.1f%%,\n"
+            " * %.0f Kops, score %.4f with weight %.2f. Build with \"make TUNED=%s\" */\n",
+            path, ntraces, util * 100, kops, s, weight, path);
+    print_values(fp, "#define ", v);
+    return fclose(fp) == 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t tracedir] [-f tracefile]... [-n reps] [-w weight]\n"
+            "          [-k kops] [-i passes] [-g pct] [-o header]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = "../traces";
+    const char *files[MAX_TRACES];
+    const char *out = "mm_tuned.h";
+    int nfiles = 0, reps = 10, passes = 4;
+    double weight = 0.6, target = 0, min_gain = 1.0;
+    size_t best[P_COUNT], v[P_COUNT];
+    double best_util, best_kops, best_score, ref_kops, util, kops, s, libc_util;
+    mm_params_t p;
+    int c, i, j, pass, changed, better;
+
+    while ((c = getopt(argc, argv, "t:f:n:w:k:i:g:o:h")) != -1) {
+        switch (c) {
+        case 't':
+            dir = optarg;
+            break;
+        case 'f':
+            if (nfiles < MAX_TRACES)
+                files[nfiles++] = optarg;
+            break;
+        case 'n':
+            reps = atoi(optarg);
+            break;
+        case 'w':
+            weight = atof(optarg);
+            break;
+        case 'k':
+            target = atof(optarg);
+            break;
+        case 'i':
+            passes = atoi(optarg);
+            break;
+        case 'g':
+            min_gain = atof(optarg);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (reps < 1)
+        reps = 1;
+    if (weight < 0 || weight > 1) {
+        fprintf(stderr, "weight must be between 0 and 1\n");
+        return 1;
+    }
+
+    if (nfiles == 0)
+        read_dir(dir);
+    for (i = 0; i < nfiles; i++) {
+        if (read_trace(NULL, files[i], &traces[ntraces]))
+            ntraces++;
+    }
+    if (ntraces == 0) {
+        fprintf(stderr, "no traces\n");
+        return 1;
+    }
+
+    mem_init();
+
+    /* The libc malloc on the same traces is the throughput reference
+     * unless a target is given */
+    ref_kops = target;
+    if (ref_kops <= 0 && (!run_all(&libc_allocator, reps, &libc_util, &ref_kops) || ref_kops <= 0)) {
+        fprintf(stderr, "the libc malloc fails on these traces\n");
+        return 1;
+    }
+
+    /* The built-in set is the starting point */
+    mm_get_params(&p);
+    get_values(&p, best);
+    if (!evaluate(best, reps, &best_util, &best_kops)) {
+        fprintf(stderr, "the built-in parameters fail on these traces\n");
+        return 1;
+    }
+    best_score = score(best_util, best_kops, weight, ref_kops);
+    printf("%d traces, weight %.2f, reference %.0f Kops%s\n",
+           ntraces, weight, ref_kops, target > 0 ? "" : " (libc)");
+    printf("built-in set: util %.1f%%, %.0f Kops, score %.4f\n",
+           best_util * 100, best_kops, best_score);
+
+    for (pass = 0; pass < passes; pass++) {
+        changed = 0;
+        for (i = 0; i < P_COUNT; i++) {
+            size_t from = best[i];
+            for (j = 0; j < grid[i].count; j++) {
+                if (grid[i].values[j] == from)
+                    continue;
+                memcpy(v, best, sizeof(v));
+                v[i] = grid[i].values[j];
+                if (!evaluate(v, reps, &util, &kops))
+                    continue;
+                s = score(util, kops, weight, ref_kops);
+                printf("  pass %d %-18s %8zu  util %5.1f%% %8.0f Kops  score %.4f",
+                       pass + 1, grid[i].knob, v[i], util * 100, kops, s);
+                better = util >= best_util && s > best_score * (1 + min_gain / 100) &&
+                         confirm(best, v, reps, weight, ref_kops, min_gain, &util, &kops, &s);
+                printf("%s\n", better ? "  *" : "");
+                if (better) {
+                    memcpy(best, v, sizeof(best));
+                    best_util = util;
+                    best_kops = kops;
+                    best_score = s;
+                }
+            }
+            changed |= best[i] != from;
+        }
+        if (!changed)
+            break;
+    }
+
+    printf("best set: util %.1f%%, %.0f Kops, score %.4f\n", best_util * 100, best_kops, best_score);
+    print_values(stdout, "  ", best);
+    mem_deinit();
+    if (!write_header(out, best, best_util, best_kops, best_score, weight))
+        return 1;
+    printf("wrote %s\n", out);
+    return 0;
+}